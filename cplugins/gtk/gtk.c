@@ -7,11 +7,15 @@
 // For mpv_gtk_helper_run() and mpv_gtk_helper_done(). Also pulls in headers.
 #include "mpv_gtk_helper.inc"
 
+#include "../../libmpv/common/wakeup_coalescer.h"
+
 // The following code is partially derived from the GTK tutorial example.
 
 struct plugin_context {
     mpv_gtk_helper_context *helper;
     GtkWidget *pbar;
+    // At most one handle_mpv_events() idle callback is queued at a time.
+    struct wakeup_coalescer wakeup;
 };
 
 static gboolean delete_event( GtkWidget *widget,
@@ -37,6 +41,7 @@ static gboolean handle_mpv_events(void *data)
     if (!ctx->helper)
         return FALSE;
 
+    wakeup_coalescer_begin(&ctx->wakeup);
     while (1) {
         mpv_event *event = mpv_wait_event(ctx->helper->mpv, 0);
         if (event->event_id == MPV_EVENT_NONE)
@@ -63,7 +68,8 @@ static gboolean handle_mpv_events(void *data)
 
 static void wakeup_mpv(void *data)
 {
-    // wakeup_mpv is called in context of an arbitrary mpv thread.
+    // wakeup_mpv is called in context of an arbitrary mpv thread (through
+    // wakeup_coalescer_notify(), only if no idle callback is pending yet).
     // Run our GUI code on the GTK thread by notifying the mainloop.
     g_idle_add(handle_mpv_events, data);
 }
@@ -75,8 +81,11 @@ static void setup_gtk_stuff(mpv_gtk_helper_context *helper)
     struct plugin_context *ctx = calloc(1, sizeof(*ctx));
     ctx->helper = helper;
 
-    // Make mpv notify us if there are new events.
-    mpv_set_wakeup_callback(ctx->helper->mpv, wakeup_mpv, ctx);
+    // Make mpv notify us if there are new events. mpv calls this for every
+    // single event, but one idle callback drains all of them.
+    wakeup_coalescer_init(&ctx->wakeup, wakeup_mpv, ctx);
+    mpv_set_wakeup_callback(ctx->helper->mpv, wakeup_coalescer_notify,
+                            &ctx->wakeup);
 
     mpv_observe_property(ctx->helper->mpv, 0, "percent-pos", MPV_FORMAT_INT64);
 
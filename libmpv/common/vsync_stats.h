@@ -0,0 +1,179 @@
+/*
+ * Present timing statistics, for measuring judder.
+ *
+ * Call vsync_stats_swap() right after every buffer swap, with the time from
+ * mpv_get_time_us() and whether the swap showed a new video frame. From that,
+ * it records:
+ *
+ *  - the distribution of present intervals, in units of the display refresh
+ *    interval (quarter steps)
+ *  - for each video frame, the number of refreshes it stayed on screen, which
+ *    should be the video frame duration in refreshes, rounded either way
+ *    (e.g. 2 and 3 for 24 fps video on a 60 Hz display, or exactly 2 for
+ *    30 fps if it differs by less than 1%, since mpv's display-resample mode
+ *    adjusts the playback speed to match)
+ *  - duplicated vsyncs: refreshes a frame stayed on screen beyond that, i.e.
+ *    the next frame came late, and this one was shown again
+ *  - short frames: frames shown for fewer refreshes than that, usually to
+ *    catch up after a late one
+ *  - missed vsyncs (in display-sync mode only, where mpv wants a swap on every
+ *    refresh): refreshes that passed without a swap
+ *
+ * Rounding assumes that a swap blocks until the next vsync, i.e. that vsync
+ * is enabled. Call vsync_stats_reset() after pausing, seeking, or anything
+ * else that interrupts playback, so the interruption isn't counted as a long
+ * frame.
+ *
+ * Works in C and C++.
+ *
+ * License: anything you like as long as you won't sue me
+ */
+
+#ifndef LIBMPV_VSYNC_STATS_H_
+#define LIBMPV_VSYNC_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Frames shown for this many refreshes or more are counted together.
+#define VSYNC_STATS_MAX_VSYNCS 8
+// Present intervals are counted in quarter refreshes, up to this many.
+#define VSYNC_STATS_INTERVALS (VSYNC_STATS_MAX_VSYNCS * 4 + 1)
+
+struct vsync_stats {
+    // Display refresh interval and video frame duration, in microseconds.
+    // Nothing is recorded while the refresh interval is 0, and frames aren't
+    // judged while the frame duration is 0.
+    int64_t vsync;
+    int64_t frame_duration;
+    // Whether mpv's display-sync mode is used.
+    int display_sync;
+    // Time of the previous swap, and of the swap that showed the current
+    // video frame. 0 if none.
+    int64_t last_swap;
+    int64_t frame_swap;
+    uint64_t swaps;
+    uint64_t frames;
+    uint64_t missed;
+    uint64_t duplicated;
+    uint64_t short_frames;
+    uint64_t intervals[VSYNC_STATS_INTERVALS];
+    uint64_t frame_vsyncs[VSYNC_STATS_MAX_VSYNCS + 1];
+};
+
+static inline void vsync_stats_init(struct vsync_stats *st, double display_fps,
+                                    int display_sync)
+{
+    memset(st, 0, sizeof(*st));
+    if (display_fps > 0)
+        st->vsync = (int64_t)(1e6 / display_fps);
+    st->display_sync = display_sync;
+}
+
+// fps is the video frame rate (e.g. the container-fps property); 0 if unknown.
+static inline void vsync_stats_set_fps(struct vsync_stats *st, double fps)
+{
+    st->frame_duration = fps > 0 ? (int64_t)(1e6 / fps) : 0;
+}
+
+static inline void vsync_stats_reset(struct vsync_stats *st)
+{
+    st->last_swap = 0;
+    st->frame_swap = 0;
+}
+
+// Internal. Number of whole refreshes in a time span, rounded.
+static inline int vsync_stats_count(struct vsync_stats *st, int64_t t, int div)
+{
+    int64_t n = (t * div + st->vsync / 2) / st->vsync;
+    return n < 0 ? 0 : n > VSYNC_STATS_MAX_VSYNCS * div
+                       ? VSYNC_STATS_MAX_VSYNCS * div : (int)n;
+}
+
+// Internal. Judge a frame that was shown for n refreshes.
+static inline void vsync_stats_frame(struct vsync_stats *st, int n)
+{
+    st->frames++;
+    st->frame_vsyncs[n]++;
+    if (st->frame_duration <= 0)
+        return;
+    double ideal = (double)st->frame_duration / st->vsync;
+    int lo = (int)ideal, hi = lo + 1;
+    int r = (int)(ideal + 0.5);
+    if (ideal - r < ideal * 0.01 && r - ideal < ideal * 0.01)
+        lo = hi = r;
+    if (n > hi)
+        st->duplicated += n - hi;
+    if (n < lo)
+        st->short_frames++;
+}
+
+// now is from mpv_get_time_us(). new_frame means the swap showed a new video
+// frame (not a redraw or a repeat of the previous one).
+static inline void vsync_stats_swap(struct vsync_stats *st, int64_t now,
+                                    int new_frame)
+{
+    if (st->vsync <= 0)
+        return;
+    st->swaps++;
+    if (st->last_swap) {
+        int64_t dt = now - st->last_swap;
+        st->intervals[vsync_stats_count(st, dt, 4)]++;
+        int n = vsync_stats_count(st, dt, 1);
+        if (st->display_sync && n > 1)
+            st->missed += n - 1;
+    }
+    if (new_frame) {
+        if (st->frame_swap) {
+            int n = vsync_stats_count(st, now - st->frame_swap, 1);
+            vsync_stats_frame(st, n);
+        }
+        st->frame_swap = now;
+    }
+    st->last_swap = now;
+}
+
+static inline void vsync_stats_write_json(const struct vsync_stats *st,
+                                          FILE *f)
+{
+    fprintf(f, "{\n  \"display_sync\": %s,\n  \"refresh_ms\": %.3f,\n"
+            "  \"frame_ms\": %.3f,\n  \"swaps\": %llu,\n  \"frames\": %llu,\n"
+            "  \"missed_vsyncs\": %llu,\n  \"duplicated_vsyncs\": %llu,\n"
+            "  \"short_frames\": %llu,\n",
+            st->display_sync ? "true" : "false", st->vsync / 1e3,
+            st->frame_duration / 1e3, (unsigned long long)st->swaps,
+            (unsigned long long)st->frames, (unsigned long long)st->missed,
+            (unsigned long long)st->duplicated,
+            (unsigned long long)st->short_frames);
+    // [refreshes, count]; the last entry includes everything above.
+    fprintf(f, "  \"present_intervals\": [");
+    int first = 1;
+    for (int n = 0; n < VSYNC_STATS_INTERVALS; n++) {
+        if (!st->intervals[n])
+            continue;
+        fprintf(f, "%s[%.2f, %llu]", first ? "" : ", ", n / 4.0,
+                (unsigned long long)st->intervals[n]);
+        first = 0;
+    }
+    // Number of frames shown for 0, 1, ... refreshes.
+    fprintf(f, "],\n  \"frame_vsyncs\": [");
+    for (int n = 0; n <= VSYNC_STATS_MAX_VSYNCS; n++) {
+        fprintf(f, "%s%llu", n ? ", " : "",
+                (unsigned long long)st->frame_vsyncs[n]);
+    }
+    fprintf(f, "]\n}\n");
+}
+
+// Write the stats as JSON to the given file. Returns 0 on success.
+static inline int vsync_stats_save(const struct vsync_stats *st,
+                                   const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    vsync_stats_write_json(st, f);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+#endif
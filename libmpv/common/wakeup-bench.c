@@ -0,0 +1,321 @@
+// Build with: gcc -o wakeup-bench wakeup-bench.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Measures how many UI thread events wakeup_coalescer.h saves. The same file
+// is played twice (vo=null, ao=null, untimed, so property changes come in as
+// fast as mpv can decode), while observing a bunch of frequently changing
+// properties:
+//
+// - direct: every wakeup callback posts one event to the UI thread, which is
+//   what the examples used to do
+// - coalesced: the wakeup callback goes through a wakeup_coalescer
+//
+// The main thread plays the UI thread: it runs an event queue, and each UI
+// event drains all mpv events with mpv_wait_event(). Dispatching a UI event
+// is given a fixed cost (busy waiting), like a toolkit's event loop has. A JSON
+// object with the counts for both modes is printed to stdout.
+//
+// Usage:
+//
+//   wakeup-bench [options] file
+//
+//   --length=SECONDS      play only this much of the file (default 10)
+//   --ui-cost-us=US       cost of dispatching one UI event (default 5)
+//   --observe=NAME        observe this property instead of the default list
+//                         (can be repeated)
+//   --log=LEVEL           also request log messages of this level, which
+//                         adds a lot of events (default: none)
+//   --set=NAME=VALUE      set an mpv option before initialization (can be
+//                         repeated)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mpv/client.h>
+
+#include "wakeup_coalescer.h"
+
+#define MAX_PROPERTIES 64
+#define MAX_OPTIONS 64
+
+static const char *const default_properties[] = {
+    "time-pos",
+    "playback-time",
+    "percent-pos",
+    "time-remaining",
+    "audio-pts",
+    "estimated-frame-number",
+    "avsync",
+    "frame-drop-count",
+    "decoder-frame-drop-count",
+    "video-bitrate",
+    "audio-bitrate",
+    "demuxer-cache-state",
+    NULL
+};
+
+static struct {
+    const char *path;
+    double length;
+    double ui_cost_us;
+    const char *properties[MAX_PROPERTIES + 1];
+    int num_properties;
+    const char *log;
+    const char *options[MAX_OPTIONS];
+    int num_options;
+} opts = {
+    .length = 10,
+    .ui_cost_us = 5,
+};
+
+// The simulated UI event queue. Only the number of queued events matters.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    uint64_t queued;
+    uint64_t max_queued;
+    uint64_t posts;
+} ui = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+struct run_stats {
+    uint64_t wakeups;
+    uint64_t posts;
+    uint64_t max_queued;
+    // UI events handled, and how many of them found no mpv event at all.
+    uint64_t dispatched;
+    uint64_t empty;
+    uint64_t mpv_events;
+    // UI events still queued when playback ended.
+    uint64_t left;
+    double wall_time;
+    double ui_time;
+};
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The toolkit's thread-safe "post event" function.
+static void ui_post(void *ctx)
+{
+    pthread_mutex_lock(&ui.lock);
+    ui.posts++;
+    ui.queued++;
+    if (ui.queued > ui.max_queued)
+        ui.max_queued = ui.queued;
+    pthread_cond_signal(&ui.wakeup);
+    pthread_mutex_unlock(&ui.lock);
+}
+
+// Number of wakeup callback calls.
+static atomic_uint_fast64_t wakeups;
+
+static void on_wakeup_direct(void *ctx)
+{
+    atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+    ui_post(NULL);
+}
+
+static void on_wakeup_coalesced(void *ctx)
+{
+    atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+    wakeup_coalescer_notify(ctx);
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Copy the NAME part of a NAME=VALUE option to name, and return VALUE.
+static const char *split_option(const char *opt, char *name, size_t name_size)
+{
+    const char *eq = strchr(opt, '=');
+    snprintf(name, name_size, "%.*s", (int)(eq - opt), opt);
+    return eq + 1;
+}
+
+static void run(bool coalesce, struct run_stats *st)
+{
+    mpv_handle *mpv = mpv_create();
+    if (!mpv)
+        die("context init failed");
+    mpv_set_option_string(mpv, "vo", "null");
+    mpv_set_option_string(mpv, "ao", "null");
+    mpv_set_option_string(mpv, "untimed", "yes");
+    char length[64];
+    snprintf(length, sizeof(length), "%f", opts.length);
+    mpv_set_option_string(mpv, "length", length);
+    for (int n = 0; n < opts.num_options; n++) {
+        char name[256];
+        const char *value = split_option(opts.options[n], name, sizeof(name));
+        if (mpv_set_option_string(mpv, name, value) < 0)
+            die("could not set option");
+    }
+    if (mpv_initialize(mpv) < 0)
+        die("mpv init failed");
+    for (int n = 0; n < opts.num_properties; n++)
+        mpv_observe_property(mpv, 0, opts.properties[n], MPV_FORMAT_NODE);
+    if (opts.log)
+        mpv_request_log_messages(mpv, opts.log);
+
+    pthread_mutex_lock(&ui.lock);
+    ui.queued = ui.max_queued = ui.posts = 0;
+    pthread_mutex_unlock(&ui.lock);
+    atomic_store(&wakeups, 0);
+
+    struct wakeup_coalescer w;
+    wakeup_coalescer_init(&w, ui_post, NULL);
+    if (coalesce) {
+        mpv_set_wakeup_callback(mpv, on_wakeup_coalesced, &w);
+    } else {
+        mpv_set_wakeup_callback(mpv, on_wakeup_direct, NULL);
+    }
+
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    if (mpv_command(mpv, cmd) < 0)
+        die("could not load file");
+
+    memset(st, 0, sizeof(*st));
+    double start = now();
+    bool done = false;
+    while (!done) {
+        pthread_mutex_lock(&ui.lock);
+        while (!ui.queued)
+            pthread_cond_wait(&ui.wakeup, &ui.lock);
+        ui.queued--;
+        pthread_mutex_unlock(&ui.lock);
+
+        double t0 = now();
+        while (now() - t0 < opts.ui_cost_us / 1e6) {}
+        if (coalesce)
+            wakeup_coalescer_begin(&w);
+        uint64_t events = 0;
+        while (1) {
+            mpv_event *event = mpv_wait_event(mpv, 0);
+            if (event->event_id == MPV_EVENT_NONE)
+                break;
+            events++;
+            if (event->event_id == MPV_EVENT_END_FILE)
+                done = true;
+        }
+        st->ui_time += now() - t0;
+        st->dispatched++;
+        st->mpv_events += events;
+        if (!events)
+            st->empty++;
+    }
+    st->wall_time = now() - start;
+
+    // Stop counting before the wakeups caused by destroying the handle.
+    pthread_mutex_lock(&ui.lock);
+    st->wakeups = atomic_load(&wakeups);
+    st->posts = ui.posts;
+    st->max_queued = ui.max_queued;
+    st->left = ui.queued;
+    pthread_mutex_unlock(&ui.lock);
+
+    mpv_set_wakeup_callback(mpv, NULL, NULL);
+    mpv_terminate_destroy(mpv);
+}
+
+static void write_run(FILE *f, const char *name, const struct run_stats *st)
+{
+    fprintf(f, "    \"%s\": {\"wakeups\": %" PRIu64 ", \"ui_events\": %"
+            PRIu64 ", \"ui_events_empty\": %" PRIu64 ", \"ui_events_left\": %"
+            PRIu64 ", \"max_queued\": %" PRIu64 ", \"mpv_events\": %" PRIu64
+            ", \"events_per_ui_event\": %.2f, \"ui_time\": %.6f, "
+            "\"wall_time\": %.6f}", name, st->wakeups, st->posts, st->empty,
+            st->left, st->max_queued, st->mpv_events,
+            st->dispatched ? (double)st->mpv_events / st->dispatched : 0,
+            st->ui_time, st->wall_time);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--length=", 9) == 0) {
+            opts.length = atof(arg + 9);
+        } else if (strncmp(arg, "--ui-cost-us=", 13) == 0) {
+            opts.ui_cost_us = atof(arg + 13);
+        } else if (strncmp(arg, "--observe=", 10) == 0) {
+            if (opts.num_properties == MAX_PROPERTIES)
+                die("too many properties");
+            opts.properties[opts.num_properties++] = arg + 10;
+        } else if (strncmp(arg, "--log=", 6) == 0) {
+            opts.log = arg + 6;
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: wakeup-bench [options] file");
+    if (!opts.num_properties) {
+        for (int n = 0; default_properties[n]; n++)
+            opts.properties[opts.num_properties++] = default_properties[n];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    struct run_stats direct, coalesced;
+    run(false, &direct);
+    run(true, &coalesced);
+
+    FILE *f = stdout;
+    fprintf(f, "{\n  \"file\": ");
+    write_json_string(f, opts.path);
+    fprintf(f, ",\n  \"length\": %.3f,\n  \"ui_cost_us\": %.3f,\n"
+            "  \"properties\": %d,\n  \"modes\": {\n", opts.length,
+            opts.ui_cost_us, opts.num_properties);
+    write_run(f, "direct", &direct);
+    fprintf(f, ",\n");
+    write_run(f, "coalesced", &coalesced);
+    uint64_t saved = direct.posts > coalesced.posts
+                     ? direct.posts - coalesced.posts : 0;
+    fprintf(f, "\n  },\n  \"ui_events_saved\": %" PRIu64 ",\n"
+            "  \"ui_events_saved_pct\": %.2f\n}\n", saved,
+            direct.posts ? 100.0 * saved / direct.posts : 0);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Coalescing of libmpv wakeup callbacks.
+ *
+ * mpv calls the wakeup callback (mpv_set_wakeup_callback()) for every new
+ * event, and the update callback (mpv_render_context_set_update_callback())
+ * for every redraw request. The usual way to handle them is to post an event
+ * to the UI thread, which then drains the mpv event queue. But one drain
+ * handles all events that are queued at that point, so with a lot of property
+ * changes, most of the posted UI events find nothing to do, and only make the
+ * UI event queue longer.
+ *
+ * A wakeup_coalescer only posts a UI event if none is pending yet:
+ *
+ *  - wakeup_coalescer_notify() is the mpv callback; it sets the pending flag,
+ *    and calls the post function only if the flag wasn't set already
+ *  - the UI event handler calls wakeup_coalescer_begin() first, which clears
+ *    the flag, and then drains everything (mpv_wait_event() until
+ *    MPV_EVENT_NONE, or mpv_render_context_update())
+ *
+ * Since the flag is cleared before draining, anything that arrives during the
+ * drain posts a new UI event, so nothing is lost. The post function is called
+ * from whatever thread invokes the mpv callback, with the same restrictions
+ * (it must not call into libmpv), and is usually the toolkit's thread-safe
+ * "post event" function.
+ *
+ * Works in C (C11 atomics, which gcc and clang also accept with -std=c99) and
+ * C++11.
+ *
+ * License: anything you like as long as you won't sue me
+ */
+
+#ifndef LIBMPV_WAKEUP_COALESCER_H_
+#define LIBMPV_WAKEUP_COALESCER_H_
+
+#ifdef __cplusplus
+#include <atomic>
+#define WAKEUP_COALESCER_STD std::
+typedef std::atomic<bool> wakeup_coalescer_flag;
+#else
+#include <stdatomic.h>
+#include <stdbool.h>
+#define WAKEUP_COALESCER_STD
+typedef atomic_bool wakeup_coalescer_flag;
+#endif
+
+struct wakeup_coalescer {
+    wakeup_coalescer_flag pending;
+    void (*post)(void *ctx);
+    void *ctx;
+};
+
+// Must be called before the callback is registered with mpv.
+static inline void wakeup_coalescer_init(struct wakeup_coalescer *w,
+                                         void (*post)(void *ctx), void *ctx)
+{
+    WAKEUP_COALESCER_STD atomic_store(&w->pending, false);
+    w->post = post;
+    w->ctx = ctx;
+}
+
+// To be passed to mpv_set_wakeup_callback() or
+// mpv_render_context_set_update_callback(), with the wakeup_coalescer as
+// context.
+static inline void wakeup_coalescer_notify(void *p)
+{
+    struct wakeup_coalescer *w = (struct wakeup_coalescer *)p;
+    if (!WAKEUP_COALESCER_STD atomic_exchange(&w->pending, true))
+        w->post(w->ctx);
+}
+
+// Call on the UI thread when handling the posted event, before draining.
+static inline void wakeup_coalescer_begin(struct wakeup_coalescer *w)
+{
+    // An exchange rather than a store: it synchronizes with the notify call
+    // that set the flag, so the drain sees everything mpv queued before it.
+    WAKEUP_COALESCER_STD atomic_exchange(&w->pending, false);
+}
+
+#undef WAKEUP_COALESCER_STD
+
+#endif
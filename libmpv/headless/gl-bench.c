@@ -0,0 +1,507 @@
+// Build with: gcc -o gl-bench gl-bench.c `pkg-config --libs --cflags mpv egl` -pthread
+//
+// Benchmark of the render API's OpenGL renderer without any window or GPU:
+// it creates a surfaceless EGL context (EGL_MESA_platform_surfaceless) on
+// Mesa's software rasterizer (llvmpipe), and renders into an offscreen FBO.
+// For each configuration (a set of mpv options, e.g. a scaler or deband), the
+// file is played from the start position as fast as possible (untimed, see
+// sw_source.inc), and every decoded frame is rendered. Decoding runs on mpv's
+// own threads in parallel, so unless the decoder is slower than the renderer,
+// the frame rate is that of the renderer. A JSON object with the results is
+// printed to stdout.
+//
+// Unlike swformat-bench, this doesn't render one paused frame over and over:
+// the OpenGL renderer caches the output of a still frame, and would only
+// measure copying it.
+//
+// LIBGL_ALWAYS_SOFTWARE=1 is set unless it's already set in the environment;
+// run with LIBGL_ALWAYS_SOFTWARE=0 to use a GPU driver instead (surfaceless
+// rendering works with most Mesa drivers).
+//
+// Usage:
+//
+//   gl-bench [options] file
+//
+//   --size=WxH        render size (default: display size of the video); with a
+//                     different size, the scale and dscale options matter
+//   --start=SECONDS   start playback at this position (default 0)
+//   --frames=N        timed frames per configuration (default 200); fewer if
+//                     the file ends before
+//   --warmup=N        untimed frames before that (default 10), which include
+//                     shader compilation
+//   --config=OPTS     a configuration to benchmark, as comma separated
+//                     NAME=VALUE options, set at runtime (can be repeated;
+//                     the default is the list in default_configs below)
+//   --gles            create an OpenGL ES 3 context instead of desktop GL
+//   --set=NAME=VALUE  set an mpv option before initialization (can be
+//                     repeated), e.g. --set=hwdec=no
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <mpv/client.h>
+#include <mpv/render_gl.h>
+
+// For struct sw_source. Also pulls in headers.
+#include "sw_source.inc"
+
+#define MAX_OPTIONS 64
+#define MAX_CONFIGS 64
+
+// Tone mapping only does anything with HDR video.
+static const char *const default_configs[] = {
+    "",
+    "scale=bilinear,dscale=bilinear,cscale=bilinear",
+    "scale=ewa_lanczossharp,dscale=mitchell,cscale=ewa_lanczossharp",
+    "deband=yes",
+    "deband=yes,deband-iterations=4",
+    "tone-mapping=bt.2390,hdr-compute-peak=yes",
+    NULL
+};
+
+// The GL functions used here. mpv loads its own.
+#define GL_TEXTURE_2D               0x0DE1
+#define GL_TEXTURE_MIN_FILTER       0x2801
+#define GL_TEXTURE_MAG_FILTER       0x2800
+#define GL_NEAREST                  0x2600
+#define GL_RGBA                     0x1908
+#define GL_RGBA8                    0x8058
+#define GL_UNSIGNED_BYTE            0x1401
+#define GL_FRAMEBUFFER              0x8D40
+#define GL_COLOR_ATTACHMENT0        0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE     0x8CD5
+#define GL_RENDERER                 0x1F01
+#define GL_VERSION                  0x1F02
+
+static struct {
+    const unsigned char *(*GetString)(unsigned int);
+    void (*GenTextures)(int, unsigned int *);
+    void (*BindTexture)(unsigned int, unsigned int);
+    void (*TexParameteri)(unsigned int, unsigned int, int);
+    void (*TexImage2D)(unsigned int, int, int, int, int, int, unsigned int,
+                       unsigned int, const void *);
+    void (*GenFramebuffers)(int, unsigned int *);
+    void (*BindFramebuffer)(unsigned int, unsigned int);
+    void (*FramebufferTexture2D)(unsigned int, unsigned int, unsigned int,
+                                 unsigned int, int);
+    unsigned int (*CheckFramebufferStatus)(unsigned int);
+    void (*DeleteFramebuffers)(int, const unsigned int *);
+    void (*DeleteTextures)(int, const unsigned int *);
+    void (*Finish)(void);
+} gl;
+
+static struct {
+    const char *path;
+    int w, h;
+    const char *start;
+    int frames;
+    int warmup;
+    const char *configs[MAX_CONFIGS + 1];
+    int num_configs;
+    bool gles;
+    const char *options[MAX_OPTIONS];
+    int num_options;
+} opts = {
+    .start = "0",
+    .frames = 200,
+    .warmup = 10,
+};
+
+struct result {
+    int frames;
+    double wall_time;
+    double min, median, mean;
+};
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : da > db;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--size=", 7) == 0) {
+            if (sscanf(arg + 7, "%dx%d", &opts.w, &opts.h) != 2 ||
+                opts.w < 1 || opts.h < 1)
+                die("invalid --size");
+        } else if (strncmp(arg, "--start=", 8) == 0) {
+            opts.start = arg + 8;
+        } else if (strncmp(arg, "--frames=", 9) == 0) {
+            opts.frames = atoi(arg + 9);
+            if (opts.frames < 1)
+                die("invalid --frames");
+        } else if (strncmp(arg, "--warmup=", 9) == 0) {
+            opts.warmup = atoi(arg + 9);
+        } else if (strncmp(arg, "--config=", 9) == 0) {
+            if (opts.num_configs == MAX_CONFIGS)
+                die("too many configurations");
+            opts.configs[opts.num_configs++] = arg + 9;
+        } else if (strcmp(arg, "--gles") == 0) {
+            opts.gles = true;
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: gl-bench [options] file");
+    if (!opts.num_configs) {
+        for (int n = 0; default_configs[n]; n++)
+            opts.configs[opts.num_configs++] = default_configs[n];
+    }
+}
+
+static bool has_extension(const char *list, const char *ext)
+{
+    size_t len = strlen(ext);
+    for (const char *s = list; s && (s = strstr(s, ext)); s += len) {
+        if ((s == list || s[-1] == ' ') && (s[len] == ' ' || !s[len]))
+            return true;
+    }
+    return false;
+}
+
+// Create a context without any surface, and make it current.
+static void init_egl(void)
+{
+    const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!has_extension(exts, "EGL_EXT_platform_base") ||
+        !has_extension(exts, "EGL_MESA_platform_surfaceless"))
+        die("EGL_MESA_platform_surfaceless not supported");
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        die("could not initialize EGL");
+    if (!has_extension(eglQueryString(display, EGL_EXTENSIONS),
+                       "EGL_KHR_surfaceless_context"))
+        die("EGL_KHR_surfaceless_context not supported");
+
+    if (!eglBindAPI(opts.gles ? EGL_OPENGL_ES_API : EGL_OPENGL_API))
+        die("could not bind the GL API");
+    // There's no surface, so the surface type doesn't matter.
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, opts.gles ? EGL_OPENGL_ES3_BIT : EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+        num_configs < 1)
+        die("no EGL config");
+    // mpv supports old GL versions too, but 3.2 core is what it prefers.
+    EGLint gl_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLint gles_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_NONE
+    };
+    EGLint *attribs = opts.gles ? gles_attribs : gl_attribs;
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                          attribs);
+    if (context == EGL_NO_CONTEXT)
+        die("could not create EGL context");
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        die("could not make EGL context current");
+
+    // Core functions can be loaded with eglGetProcAddress() only with
+    // EGL_KHR_get_all_proc_addresses, but Mesa (and libglvnd) support that.
+    void **fns[] = {
+        (void **)&gl.GetString, (void **)&gl.GenTextures,
+        (void **)&gl.BindTexture, (void **)&gl.TexParameteri,
+        (void **)&gl.TexImage2D, (void **)&gl.GenFramebuffers,
+        (void **)&gl.BindFramebuffer, (void **)&gl.FramebufferTexture2D,
+        (void **)&gl.CheckFramebufferStatus, (void **)&gl.DeleteFramebuffers,
+        (void **)&gl.DeleteTextures, (void **)&gl.Finish,
+    };
+    static const char *const names[] = {
+        "glGetString", "glGenTextures", "glBindTexture", "glTexParameteri",
+        "glTexImage2D", "glGenFramebuffers", "glBindFramebuffer",
+        "glFramebufferTexture2D", "glCheckFramebufferStatus",
+        "glDeleteFramebuffers", "glDeleteTextures", "glFinish",
+    };
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        *fns[n] = (void *)eglGetProcAddress(names[n]);
+        if (!*fns[n])
+            die("missing GL function");
+    }
+}
+
+static void *get_proc_address(void *ctx, const char *name)
+{
+    return (void *)eglGetProcAddress(name);
+}
+
+// Create a w x h RGBA8 texture with an FBO for rendering into it.
+static unsigned int create_fbo(int w, int h, unsigned int *tex)
+{
+    gl.GenTextures(1, tex);
+    gl.BindTexture(GL_TEXTURE_2D, *tex);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA,
+                  GL_UNSIGNED_BYTE, NULL);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+
+    unsigned int fbo;
+    gl.GenFramebuffers(1, &fbo);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl.FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_2D, *tex, 0);
+    if (gl.CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        die("could not create FBO");
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    return fbo;
+}
+
+// Render the frame reported by sw_source_wait(). With fbo 0, skip it.
+static int render(struct sw_source *src, unsigned int fbo)
+{
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_OPENGL_FBO, &(mpv_opengl_fbo){
+            .fbo = fbo,
+            .w = opts.w,
+            .h = opts.h,
+            .internal_format = GL_RGBA8,
+        }},
+        // There is no display whose refresh the frame would have to wait for.
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int){0}},
+        {MPV_RENDER_PARAM_SKIP_RENDERING, &(int){1}},
+        {0}
+    };
+    if (fbo)
+        params[2].type = MPV_RENDER_PARAM_INVALID; // terminates the list
+    int r = mpv_render_context_render(src->rd, params);
+    // Rendering is asynchronous, also with llvmpipe.
+    if (fbo)
+        gl.Finish();
+    return r;
+}
+
+// Set the comma separated NAME=VALUE options in config, or restore the values
+// saved in old (when restoring, old is freed). Returns false if an option
+// could not be set.
+static bool apply_config(struct sw_source *src, const char *config,
+                         char **old, bool restore)
+{
+    bool ok = true;
+    int n = 0;
+    const char *s = config;
+    while (*s) {
+        size_t len = strcspn(s, ",");
+        char opt[512];
+        snprintf(opt, sizeof(opt), "%.*s", (int)len, s);
+        s += len + (s[len] == ',');
+        char *eq = strchr(opt, '=');
+        if (!eq || n == MAX_OPTIONS) {
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+        if (restore) {
+            if (old[n])
+                mpv_set_property_string(src->mpv, opt, old[n]);
+            mpv_free(old[n]);
+        } else {
+            old[n] = mpv_get_property_string(src->mpv, opt);
+            if (mpv_set_property_string(src->mpv, opt, eq + 1) < 0)
+                ok = false;
+        }
+        n++;
+    }
+    return ok;
+}
+
+// Play the file from the start position, and render every frame. Returns
+// false if the file couldn't be played.
+static bool run(struct sw_source *src, unsigned int *fbo, unsigned int *tex,
+                double *times, struct result *res)
+{
+    memset(res, 0, sizeof(*res));
+    mpv_set_property_string(src->mpv, "start", opts.start);
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    if (mpv_command(src->mpv, cmd) < 0)
+        return false;
+
+    // Frames and END_FILE before START_FILE are left over from the previous
+    // run.
+    bool started = false;
+    int count = 0;
+    double start = 0;
+    while (count < opts.warmup + opts.frames) {
+        mpv_event *event = sw_source_wait(src, 30);
+        if (!event) {
+            if (!started) {
+                render(src, 0);
+                continue;
+            }
+            // The size is only known once there is video.
+            if (!*fbo) {
+                if (!opts.w && !sw_source_video_size(src, &opts.w, &opts.h))
+                    die("no video size");
+                *fbo = create_fbo(opts.w, opts.h, tex);
+            }
+            if (count == opts.warmup)
+                start = now_seconds();
+            double t = now_seconds();
+            int r = render(src, *fbo);
+            if (r < 0) {
+                fprintf(stderr, "render error: %s\n", mpv_error_string(r));
+                exit(1);
+            }
+            if (count >= opts.warmup)
+                times[count - opts.warmup] = now_seconds() - t;
+            count++;
+            continue;
+        }
+        if (event->event_id == MPV_EVENT_NONE)
+            die("timeout");
+        if (event->event_id == MPV_EVENT_START_FILE)
+            started = true;
+        if (event->event_id == MPV_EVENT_END_FILE && started)
+            break;
+    }
+    if (count <= opts.warmup)
+        return count > 0;
+
+    res->frames = count - opts.warmup;
+    res->wall_time = now_seconds() - start;
+    double sum = 0;
+    for (int n = 0; n < res->frames; n++)
+        sum += times[n];
+    qsort(times, res->frames, sizeof(double), compare_double);
+    res->min = times[0];
+    res->median = times[res->frames / 2];
+    res->mean = sum / res->frames;
+
+    const char *stop[] = {"stop", NULL};
+    mpv_command(src->mpv, stop);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    // Must be set before the EGL display is initialized.
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    init_egl();
+
+    const char *options[MAX_OPTIONS + 1] = {0};
+    for (int n = 0; n < opts.num_options; n++)
+        options[n] = opts.options[n];
+
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_OPENGL},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &(mpv_opengl_init_params){
+            .get_proc_address = get_proc_address,
+        }},
+        {0}
+    };
+    struct sw_source src;
+    if (sw_source_init_params(&src, options, params) < 0)
+        die("mpv init failed");
+
+    double *times = malloc(sizeof(double) * opts.frames);
+    if (!times)
+        die("out of memory");
+
+    FILE *f = stdout;
+    fprintf(f, "{\n  \"file\": ");
+    write_json_string(f, opts.path);
+    fprintf(f, ",\n  \"gl_renderer\": ");
+    write_json_string(f, (const char *)gl.GetString(GL_RENDERER));
+    fprintf(f, ",\n  \"gl_version\": ");
+    write_json_string(f, (const char *)gl.GetString(GL_VERSION));
+    fprintf(f, ",\n  \"results\": [");
+
+    unsigned int fbo = 0, tex = 0;
+    for (int i = 0; i < opts.num_configs; i++) {
+        const char *config = opts.configs[i];
+        fprintf(f, "%s\n    {\"config\": ", i ? "," : "");
+        write_json_string(f, config);
+
+        char *old[MAX_OPTIONS] = {0};
+        struct result res;
+        if (!apply_config(&src, config, old, false)) {
+            fprintf(f, ", \"error\": \"could not set options\"}");
+        } else if (!run(&src, &fbo, &tex, times, &res)) {
+            fprintf(f, ", \"error\": \"playback failed\"}");
+        } else if (!res.frames) {
+            fprintf(f, ", \"error\": \"not enough frames\"}");
+        } else {
+            fprintf(f, ", \"frames\": %d, \"fps\": %.2f, \"min_ms\": %.3f, "
+                    "\"median_ms\": %.3f, \"mean_ms\": %.3f}", res.frames,
+                    res.frames / res.wall_time, res.min * 1e3,
+                    res.median * 1e3, res.mean * 1e3);
+        }
+        apply_config(&src, config, old, true);
+        fflush(f);
+    }
+    fprintf(f, "\n  ],\n  \"width\": %d,\n  \"height\": %d\n}\n", opts.w,
+            opts.h);
+
+    if (fbo) {
+        gl.DeleteFramebuffers(1, &fbo);
+        gl.DeleteTextures(1, &tex);
+    }
+    free(times);
+    sw_source_destroy(&src);
+    return 0;
+}
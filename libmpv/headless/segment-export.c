@@ -0,0 +1,570 @@
+// Build with: gcc -o segment-export segment-export.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Segment-parallel frame exporter. Splits the timeline of one (long) file into
+// K segments, decodes each with its own headless mpv instance (see
+// sw_source.inc), and writes all frames in order to stdout or a file, as raw
+// packed RGB. The output is the same as a single-threaded export (e.g. with
+// sw-export), but decoding scales across cores.
+//
+// Usage:
+//
+//   segment-export [options] file > frames.raw
+//
+//   --segments=K      number of segments (default: number of CPUs)
+//   --format=FMT      rgb0 (default), bgr0, 0rgb, 0bgr, rgb24 or bgr24
+//   --size=WxH        output size (default: video display size)
+//   --output=PATH     write to PATH instead of stdout
+//   --tmpdir=DIR      where to spool segments that are ahead of the output
+//                     (default: $TMPDIR, or /tmp)
+//   --margin=SECONDS  how much earlier than its boundary a segment starts
+//                     decoding (default 0.5)
+//   --set=NAME=VALUE  set an mpv option on each instance (can be repeated)
+//
+// Segment i owns the frames with timestamps in [t_i, t_i+1), where t_i is
+// i/K of the duration. Each instance starts paused at t_i minus the margin,
+// and decides per frame whether it keeps it, by its timestamp. With untimed
+// playback, the core may already queue the next frame while the VO waits for
+// the current one to be rendered, so time-pos can't be trusted while playing.
+// Instead, the instance advances with frame-step: the core pauses again right
+// after queueing the stepped frame, so time-pos is its timestamp. (The first
+// frame is the one shown when the initial seek is done.) Frames before t_i
+// are consumed without rendering, and the instance stops at the first frame
+// at or after t_i+1, which must be the first frame of the next segment. That
+// way, every frame is written exactly once, no matter where the keyframes
+// are, and gaps or overlaps between segments are detected.
+//
+// Each segment is written to an unlinked temporary file. The output side
+// streams the segments in order with sendfile(), starting with the first one
+// while it's still being decoded. So output starts immediately, and only the
+// segments that are ahead of the output take disk space (the already sent
+// parts of the current one are freed with FALLOC_FL_PUNCH_HOLE).
+//
+// At the end, per-segment frame accounting is printed as JSON to stderr:
+// frames written and skipped, the first and last timestamp written, the
+// timestamp the segment stopped at, and frames dropped by the VO (which would
+// make the output incomplete). The exit status is non-zero if any segment
+// failed or dropped frames, or if the segments don't line up.
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <mpv/client.h>
+#include <mpv/render.h>
+
+// For struct sw_source. Also pulls in headers.
+#include "sw_source.inc"
+
+#define MAX_OPTIONS 64
+
+static struct {
+    const char *path;
+    int segments;
+    const char *format;
+    int w, h;
+    const char *output;
+    const char *tmpdir;
+    double margin;
+    const char *options[MAX_OPTIONS];
+    int num_options;
+} opts = {
+    .format = "rgb0",
+    .margin = 0.5,
+};
+
+struct segment {
+    int index;
+    pthread_t thread;
+    // Frames with start <= pts < end are written (-inf/inf at the ends).
+    double start, end;
+    // Spool file. The segment thread appends to it, the main thread reads it
+    // with explicit offsets.
+    int fd;
+    // Protected by lock.
+    int64_t bytes;
+    bool done;
+    // Accounting; written by the segment thread, read after it's done.
+    int64_t frames, skipped, dropped;
+    double first_pts, last_pts;
+    // Timestamp of the frame left to the next segment; has_next is false if
+    // the file ended first.
+    double next_pts;
+    bool has_next;
+    const char *error;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress = PTHREAD_COND_INITIALIZER;
+
+static struct segment *segments;
+static int out_w, out_h, bpp;
+static int out_fd = 1;
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t r = write(fd, data, size);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        data += r;
+        size -= r;
+    }
+    return true;
+}
+
+// Write the first size bytes of each of the h lines of an image.
+static bool write_lines(int fd, char *data, size_t size, size_t stride, int h)
+{
+    if (size == stride) {
+        size *= h;
+        h = 1;
+    }
+    struct iovec iov[64];
+    for (int y = 0; y < h;) {
+        int num = 0;
+        while (num < 64 && y < h)
+            iov[num++] = (struct iovec){data + y++ * stride, size};
+        struct iovec *p = iov;
+        while (num > 0) {
+            ssize_t r = writev(fd, p, num);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                return false;
+            while (num > 0 && (size_t)r >= p->iov_len) {
+                r -= p->iov_len;
+                p++;
+                num--;
+            }
+            if (num > 0) {
+                p->iov_base = (char *)p->iov_base + r;
+                p->iov_len -= r;
+            }
+        }
+    }
+    return true;
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Get the duration and display size of the file, with a throwaway mpv
+// instance that doesn't render anything.
+static bool probe(double *duration, int *w, int *h)
+{
+    mpv_handle *mpv = mpv_create();
+    if (!mpv)
+        return false;
+    mpv_set_option_string(mpv, "vo", "null");
+    mpv_set_option_string(mpv, "aid", "no");
+    mpv_set_option_string(mpv, "pause", "yes");
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    bool ok = mpv_initialize(mpv) >= 0 && mpv_command(mpv, cmd) >= 0;
+    int64_t dw = 0, dh = 0;
+    *duration = 0;
+    while (ok && (*duration <= 0 || dw <= 0 || dh <= 0)) {
+        mpv_event *event = mpv_wait_event(mpv, 30);
+        if (event->event_id == MPV_EVENT_FILE_LOADED) {
+            mpv_get_property(mpv, "duration", MPV_FORMAT_DOUBLE, duration);
+        } else if (event->event_id == MPV_EVENT_VIDEO_RECONFIG) {
+            mpv_get_property(mpv, "dwidth", MPV_FORMAT_INT64, &dw);
+            mpv_get_property(mpv, "dheight", MPV_FORMAT_INT64, &dh);
+        } else if (event->event_id == MPV_EVENT_END_FILE ||
+                   event->event_id == MPV_EVENT_SHUTDOWN ||
+                   event->event_id == MPV_EVENT_NONE)
+        {
+            ok = false;
+        }
+    }
+    mpv_terminate_destroy(mpv);
+    *w = dw;
+    *h = dh;
+    return ok;
+}
+
+static void *segment_thread(void *arg)
+{
+    struct segment *seg = arg;
+    bool has_start = !isinf(seg->start), has_end = !isinf(seg->end);
+
+    // The start is only approximate; the frames are picked below. There is
+    // no end option: the segment stops once it sees the next one's frame.
+    char start[64];
+    snprintf(start, sizeof(start), "start=%f", seg->start - opts.margin);
+    const char *options[MAX_OPTIONS + 5];
+    int num_options = 0;
+    // Every core is already busy with a segment.
+    options[num_options++] = "vd-lavc-threads=1";
+    options[num_options++] = "hr-seek=yes";
+    options[num_options++] = "pause=yes";
+    if (has_start && seg->start - opts.margin > 0)
+        options[num_options++] = start;
+    for (int n = 0; n < opts.num_options; n++)
+        options[num_options++] = opts.options[n];
+    options[num_options] = NULL;
+
+    struct sw_source src;
+    if (sw_source_init(&src, options) < 0) {
+        seg->error = "mpv init failed";
+        goto done;
+    }
+
+    size_t row = (size_t)out_w * bpp;
+    size_t stride = (row + 63) & ~(size_t)63;
+    void *mem = malloc(stride * out_h + 63);
+    char *pixels = (char *)(((uintptr_t)mem + 63) & ~(uintptr_t)63);
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    if (!mem || mpv_command(src.mpv, cmd) < 0)
+        seg->error = "loadfile failed";
+
+    bool restarted = false;
+    while (!seg->error) {
+        mpv_event *event = sw_source_wait(&src, -1);
+        if (!event && !restarted) {
+            // Shown while loading or seeking; it's unknown which frame this
+            // is, but the one current at the restart is handled below.
+            int r = sw_source_render(&src, out_w, out_h, opts.format, NULL,
+                                     stride);
+            if (r < 0)
+                seg->error = mpv_error_string(r);
+            continue;
+        } else if (event && event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+            if (restarted)
+                continue;
+            restarted = true;
+        } else if (event && event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = event->data;
+            if (ef->reason == MPV_END_FILE_REASON_ERROR)
+                seg->error = mpv_error_string(ef->error);
+            break;
+        } else if (event && event->event_id == MPV_EVENT_SHUTDOWN) {
+            break;
+        } else if (event) {
+            continue;
+        }
+
+        // Paused on a frame: either the stepped one that was just reported,
+        // or the current one after the initial seek (rendered again).
+        double pts = 0;
+        mpv_get_property(src.mpv, "time-pos", MPV_FORMAT_DOUBLE, &pts);
+        bool before = has_start && pts < seg->start;
+        bool after = has_end && pts >= seg->end;
+        int r = sw_source_render(&src, out_w, out_h, opts.format,
+                                 before || after ? NULL : pixels, stride);
+        if (r < 0) {
+            seg->error = mpv_error_string(r);
+        } else if (after) {
+            // The next segment must start with this frame.
+            seg->next_pts = pts;
+            seg->has_next = true;
+            break;
+        } else if (before) {
+            seg->skipped++;
+        } else {
+            if (!write_lines(seg->fd, pixels, row, stride, out_h))
+                seg->error = "could not write to the spool file";
+            if (!seg->frames)
+                seg->first_pts = pts;
+            seg->last_pts = pts;
+            seg->frames++;
+            pthread_mutex_lock(&lock);
+            seg->bytes += row * out_h;
+            pthread_cond_broadcast(&progress);
+            pthread_mutex_unlock(&lock);
+        }
+
+        const char *step[] = {"frame-step", NULL};
+        if (!seg->error && mpv_command(src.mpv, step) < 0)
+            seg->error = "frame-step failed";
+    }
+
+    mpv_get_property(src.mpv, "frame-drop-count", MPV_FORMAT_INT64,
+                     &seg->dropped);
+    sw_source_destroy(&src);
+    free(mem);
+
+done:
+    pthread_mutex_lock(&lock);
+    seg->done = true;
+    pthread_cond_broadcast(&progress);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// Copy size bytes at *offset from in_fd to out_fd, advancing *offset.
+static bool copy_range(int in_fd, off_t *offset, int64_t size)
+{
+    bool use_sendfile = true;
+    static char buf[1 << 20];
+    while (size > 0) {
+        size_t chunk = size < (1 << 30) ? size : (1 << 30);
+        ssize_t r;
+        if (use_sendfile) {
+            r = sendfile(out_fd, in_fd, offset, chunk);
+            // E.g. output to a terminal, or an old kernel.
+            if (r < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                use_sendfile = false;
+                continue;
+            }
+        } else {
+            r = pread(in_fd, buf, chunk < sizeof(buf) ? chunk : sizeof(buf),
+                      *offset);
+            if (r > 0 && !write_all(out_fd, buf, r))
+                return false;
+            if (r > 0)
+                *offset += r;
+        }
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        size -= r;
+    }
+    return true;
+}
+
+// Send a segment's frames to the output as they're written to its spool.
+static bool output_segment(struct segment *seg)
+{
+    off_t sent = 0, freed = 0;
+    while (1) {
+        pthread_mutex_lock(&lock);
+        while (seg->bytes == sent && !seg->done)
+            pthread_cond_wait(&progress, &lock);
+        int64_t avail = seg->bytes;
+        bool done = seg->done;
+        pthread_mutex_unlock(&lock);
+        if (avail == sent && done)
+            return true;
+        if (!copy_range(seg->fd, &sent, avail - sent))
+            return false;
+#ifdef FALLOC_FL_PUNCH_HOLE
+        // Give back the disk space of what was sent, in big steps.
+        if (sent - freed >= (64 << 20)) {
+            fallocate(seg->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0,
+                      sent);
+            freed = sent;
+        }
+#endif
+    }
+}
+
+// Create an unlinked temporary file, which disappears when it's closed, even
+// if the process crashes.
+static int open_spool(void)
+{
+    int fd = open(opts.tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0)
+        return fd;
+    // File systems without O_TMPFILE.
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/segment-export-XXXXXX", opts.tmpdir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+static void print_pts(double pts, bool valid)
+{
+    if (valid && !isinf(pts)) {
+        fprintf(stderr, "%.6f", pts);
+    } else {
+        fprintf(stderr, "null");
+    }
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    static const char *const formats[] = {
+        "rgb0", "bgr0", "0rgb", "0bgr", "rgb24", "bgr24", NULL
+    };
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--segments=", 11) == 0) {
+            opts.segments = atoi(arg + 11);
+        } else if (strncmp(arg, "--format=", 9) == 0) {
+            opts.format = arg + 9;
+            int i = 0;
+            while (formats[i] && strcmp(formats[i], opts.format))
+                i++;
+            if (!formats[i])
+                die("unknown format");
+        } else if (strncmp(arg, "--size=", 7) == 0) {
+            if (sscanf(arg + 7, "%dx%d", &opts.w, &opts.h) != 2 ||
+                opts.w < 1 || opts.h < 1)
+                die("invalid --size");
+        } else if (strncmp(arg, "--output=", 9) == 0) {
+            opts.output = arg + 9;
+        } else if (strncmp(arg, "--tmpdir=", 9) == 0) {
+            opts.tmpdir = arg + 9;
+        } else if (strncmp(arg, "--margin=", 9) == 0) {
+            opts.margin = atof(arg + 9);
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: segment-export [options] file");
+    if (!opts.tmpdir)
+        opts.tmpdir = getenv("TMPDIR");
+    if (!opts.tmpdir)
+        opts.tmpdir = "/tmp";
+    if (opts.segments < 1)
+        opts.segments = sysconf(_SC_NPROCESSORS_ONLN);
+    if (opts.segments < 1)
+        opts.segments = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    double duration;
+    int vw, vh;
+    if (!probe(&duration, &vw, &vh))
+        die("could not determine duration and size of the file");
+    out_w = opts.w ? opts.w : vw;
+    out_h = opts.h ? opts.h : vh;
+    bpp = strstr(opts.format, "24") ? 3 : 4;
+
+    if (opts.output) {
+        out_fd = open(opts.output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+        if (out_fd < 0)
+            die("could not open output");
+    }
+
+    int num = opts.segments;
+    segments = calloc(num, sizeof(segments[0]));
+    if (!segments)
+        die("out of memory");
+    double start_time = now_seconds();
+    for (int n = 0; n < num; n++) {
+        struct segment *seg = &segments[n];
+        seg->index = n;
+        seg->start = n ? duration * n / num : -INFINITY;
+        seg->end = n < num - 1 ? duration * (n + 1) / num : INFINITY;
+        seg->fd = open_spool();
+        if (seg->fd < 0)
+            die("could not create spool file");
+        if (pthread_create(&seg->thread, NULL, segment_thread, seg))
+            die("could not create segment thread");
+    }
+
+    // Segments are output in order, each while (or after) it's decoded.
+    bool ok = true;
+    for (int n = 0; n < num; n++) {
+        struct segment *seg = &segments[n];
+        if (ok && !output_segment(seg)) {
+            fprintf(stderr, "could not write output\n");
+            ok = false;
+        }
+        pthread_join(seg->thread, NULL);
+        close(seg->fd);
+    }
+    double secs = now_seconds() - start_time;
+
+    int64_t frames = 0;
+    fprintf(stderr, "{\"file\": ");
+    write_json_string(stderr, opts.path);
+    fprintf(stderr, ", \"duration\": %.6f, \"size\": [%d, %d], "
+            "\"format\": \"%s\", \"segments\": [", duration, out_w, out_h,
+            opts.format);
+    for (int n = 0; n < num; n++) {
+        struct segment *seg = &segments[n];
+        frames += seg->frames;
+        if (seg->error || seg->dropped)
+            ok = false;
+        // Each segment must begin with the frame the one before stopped at
+        // (the first frame it writes, or the one it stops at itself if it's
+        // empty); anything else is an overlap or a gap. Segments after the
+        // end of the file are empty (e.g. more segments than frames).
+        bool lined_up = true;
+        if (n > 0) {
+            struct segment *prev = &segments[n - 1];
+            bool begins = seg->frames || seg->has_next;
+            double first = seg->frames ? seg->first_pts : seg->next_pts;
+            lined_up = prev->has_next == begins &&
+                       (!begins || prev->next_pts == first);
+        }
+        if (!lined_up)
+            ok = false;
+        fprintf(stderr, "%s{\"start\": ", n ? ", " : "");
+        print_pts(seg->start, true);
+        fprintf(stderr, ", \"end\": ");
+        print_pts(seg->end, true);
+        fprintf(stderr, ", \"frames\": %" PRId64 ", \"skipped\": %" PRId64
+                ", \"dropped\": %" PRId64 ", \"first_pts\": ", seg->frames,
+                seg->skipped, seg->dropped);
+        print_pts(seg->first_pts, seg->frames > 0);
+        fprintf(stderr, ", \"last_pts\": ");
+        print_pts(seg->last_pts, seg->frames > 0);
+        fprintf(stderr, ", \"next_pts\": ");
+        print_pts(seg->next_pts, seg->has_next);
+        fprintf(stderr, ", \"lined_up\": %s, \"error\": ",
+                lined_up ? "true" : "false");
+        if (seg->error) {
+            fprintf(stderr, "\"%s\"}", seg->error);
+        } else {
+            fprintf(stderr, "null}");
+        }
+    }
+    fprintf(stderr, "], \"frames\": %" PRId64 ", \"seconds\": %.3f, "
+            "\"fps\": %.1f, \"ok\": %s}\n", frames, secs, frames / secs,
+            ok ? "true" : "false");
+
+    if (opts.output)
+        close(out_fd);
+    free(segments);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,484 @@
+// Build with: gcc -o sw-export sw-export.c `pkg-config --libs --cflags mpv` -pthread -lm
+//
+// Headless frame exporter. Decodes a file with the software renderer (see
+// sw_source.inc) and writes every video frame to stdout, or to a file or FIFO,
+// either as raw packed RGB, or as YUV4MPEG2, which ffmpeg and most analysis
+// tools can read directly:
+//
+//   sw-export input.mkv | ffmpeg -i - ...
+//   sw-export --format=rgb24 --size=320x180 input.mkv > frames.rgb
+//
+// Usage:
+//
+//   sw-export [options] file
+//
+//   --format=FMT      y4m (default), or a raw format: rgb0, bgr0, 0rgb,
+//                     0bgr, rgb24, bgr24
+//   --size=WxH        output size (default: display size of the first frame);
+//                     frames of a different size are scaled to it
+//   --output=PATH     write to PATH instead of stdout (e.g. a FIFO)
+//   --buffers=N       number of frame buffers (default 8)
+//   --set=NAME=VALUE  set an mpv option before initialization (can be
+//                     repeated), e.g. --set=vf=fps=1
+//
+// The main thread renders frames into a ring of preallocated, 64 byte aligned
+// buffers. A writer thread writes them with writev() directly from the ring,
+// and takes all frames finished since its last write in one call, so small
+// frames don't cost a syscall each. For Y4M, the writer first converts the
+// RGB frame to planar YUV 4:4:4 (BT.601, limited range), since the software
+// renderer only outputs packed RGB.
+//
+// Decoding runs ahead of the writer by at most the number of buffers: when
+// 3/4 of them are filled, playback is paused, and it's resumed once the writer
+// drained them to 1/4. (Simply blocking the renderer is not enough, because
+// libmpv drops a frame that isn't rendered within about 200ms.)
+//
+// Statistics are printed to stderr at the end.
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <mpv/client.h>
+#include <mpv/render.h>
+
+// For struct sw_source. Also pulls in headers.
+#include "sw_source.inc"
+
+#define MAX_OPTIONS 64
+
+struct frame_buf {
+    void *mem;
+    // mem, aligned to 64 bytes.
+    char *pixels;
+    // Y4M only, owned by the writer thread: the frame as planar YUV.
+    char *planar;
+};
+
+static struct {
+    const char *path;
+    const char *format;
+    const char *output;
+    int w, h;
+    int buffers;
+    const char *options[MAX_OPTIONS + 1];
+    int num_options;
+} opts = {
+    .format = "y4m",
+    .buffers = 8,
+};
+
+// Set up on the first frame, constant afterwards.
+static int out_w, out_h;
+static int bpp;
+static size_t stride;
+static int fps_num, fps_den;
+
+// Ring state shared by the main thread and the writer thread.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct frame_buf *bufs;
+    // Buffer the next frame is rendered to.
+    int head;
+    // Number of rendered frames not written yet, ending before head.
+    int count;
+    // No more frames will be rendered.
+    bool eof;
+    // The writer failed (e.g. the reader closed the pipe).
+    bool failed;
+    bool paused;
+} ring = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static struct {
+    int64_t frames;
+    int64_t bytes;
+    int64_t writes;
+    int64_t pauses;
+    // Times the renderer found all buffers full.
+    int64_t full_waits;
+} stats;
+
+static mpv_handle *mpv;
+static int out_fd = 1;
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Write all of iov, resuming after short writes. Modifies iov.
+static bool write_iov(int fd, struct iovec *iov, int num)
+{
+    while (num > 0) {
+        ssize_t r = writev(fd, iov, num < IOV_MAX ? num : IOV_MAX);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        stats.bytes += r;
+        stats.writes++;
+        while (num > 0 && (size_t)r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            num--;
+        }
+        if (num > 0) {
+            iov->iov_base = (char *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+    return true;
+}
+
+// Batches writes into one writev() call, until IOV_MAX entries are used.
+struct iov_batch {
+    struct iovec iov[IOV_MAX];
+    int num;
+};
+
+static bool flush_iov(struct iov_batch *b)
+{
+    bool ok = write_iov(out_fd, b->iov, b->num);
+    b->num = 0;
+    return ok;
+}
+
+static bool push_iov(struct iov_batch *b, void *base, size_t len)
+{
+    if (b->num == IOV_MAX && !flush_iov(b))
+        return false;
+    b->iov[b->num++] = (struct iovec){base, len};
+    return true;
+}
+
+// Convert an RGB0 frame to planar YUV 4:4:4 (BT.601, limited range).
+static void rgb0_to_yuv444p(char *dst, const char *src)
+{
+    uint8_t *py = (uint8_t *)dst;
+    uint8_t *pu = py + (size_t)out_w * out_h;
+    uint8_t *pv = pu + (size_t)out_w * out_h;
+    for (int y = 0; y < out_h; y++) {
+        const uint8_t *p = (const uint8_t *)src + y * stride;
+        for (int x = 0; x < out_w; x++) {
+            int r = p[0], g = p[1], b = p[2];
+            *py++ = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            *pu++ = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            *pv++ = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            p += 4;
+        }
+    }
+}
+
+static void *writer_thread(void *arg)
+{
+    bool y4m = strcmp(opts.format, "y4m") == 0;
+    bool header_done = !y4m;
+    static const char frame_header[] = "FRAME\n";
+    size_t row = (size_t)out_w * bpp;
+    size_t planar_size = (size_t)out_w * out_h * 3;
+    // Too big for the stack.
+    static struct iov_batch batch;
+
+    pthread_mutex_lock(&ring.lock);
+    while (1) {
+        while (!ring.count && !ring.eof)
+            pthread_cond_wait(&ring.cond, &ring.lock);
+        int num = ring.count;
+        if (!num)
+            break;
+        int first = (ring.head - num + opts.buffers) % opts.buffers;
+        pthread_mutex_unlock(&ring.lock);
+
+        // The renderer doesn't touch these buffers until they're released.
+        bool ok = true;
+        if (!header_done) {
+            char header[128];
+            int len = snprintf(header, sizeof(header),
+                               "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444 "
+                               "XCOLORRANGE=LIMITED\n",
+                               out_w, out_h, fps_num, fps_den);
+            ok = write_iov(out_fd, &(struct iovec){header, len}, 1);
+            header_done = true;
+        }
+        for (int n = 0; n < num && ok; n++) {
+            struct frame_buf *buf = &ring.bufs[(first + n) % opts.buffers];
+            if (y4m) {
+                if (!buf->planar && !(buf->planar = malloc(planar_size))) {
+                    ok = false;
+                    break;
+                }
+                rgb0_to_yuv444p(buf->planar, buf->pixels);
+                ok = push_iov(&batch, (void *)frame_header,
+                              sizeof(frame_header) - 1) &&
+                     push_iov(&batch, buf->planar, planar_size);
+            } else if (stride == row) {
+                ok = push_iov(&batch, buf->pixels, row * out_h);
+            } else {
+                // Skip the padding at the end of each line.
+                for (int y = 0; y < out_h && ok; y++)
+                    ok = push_iov(&batch, buf->pixels + y * stride, row);
+            }
+        }
+        // Nothing may refer to the buffers once they're released.
+        if (ok)
+            ok = flush_iov(&batch);
+        batch.num = 0;
+
+        pthread_mutex_lock(&ring.lock);
+        ring.count -= num;
+        if (!ok) {
+            ring.failed = true;
+            pthread_cond_broadcast(&ring.cond);
+            break;
+        }
+        if (ring.paused && ring.count <= opts.buffers / 4) {
+            ring.paused = false;
+            mpv_set_property_async(mpv, 0, "pause", MPV_FORMAT_FLAG,
+                                   &(int){0});
+        }
+        pthread_cond_broadcast(&ring.cond);
+    }
+    pthread_mutex_unlock(&ring.lock);
+    return NULL;
+}
+
+// Pick the Y4M frame rate: NTSC-style rates are written as N*1000/1001.
+static void set_fps(double fps)
+{
+    if (!(fps > 0))
+        fps = 25;
+    if (fabs(fps - round(fps)) < 0.001) {
+        fps_num = round(fps);
+        fps_den = 1;
+    } else if (fabs(fps * 1.001 - round(fps * 1.001)) < 0.005) {
+        fps_num = round(fps * 1.001) * 1000;
+        fps_den = 1001;
+    } else {
+        fps_num = round(fps * 1000);
+        fps_den = 1000;
+    }
+}
+
+// Called on the first frame: fix the output geometry, allocate the ring, and
+// start the writer.
+static void setup_output(struct sw_source *src, pthread_t *writer)
+{
+    out_w = opts.w;
+    out_h = opts.h;
+    if ((!out_w || !out_h) && !sw_source_video_size(src, &out_w, &out_h))
+        die("could not determine the video size");
+
+    double fps = 0;
+    mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &fps);
+    set_fps(fps);
+
+    bpp = strstr(opts.format, "24") ? 3 : 4;
+    stride = ((size_t)out_w * bpp + 63) & ~(size_t)63;
+
+    ring.bufs = calloc(opts.buffers, sizeof(ring.bufs[0]));
+    if (!ring.bufs)
+        die("out of memory");
+    for (int n = 0; n < opts.buffers; n++) {
+        struct frame_buf *buf = &ring.bufs[n];
+        buf->mem = malloc(stride * out_h + 63);
+        if (!buf->mem)
+            die("out of memory");
+        buf->pixels = (char *)(((uintptr_t)buf->mem + 63) & ~(uintptr_t)63);
+    }
+
+    if (pthread_create(writer, NULL, writer_thread, NULL))
+        die("could not create writer thread");
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    static const char *const formats[] = {
+        "y4m", "rgb0", "bgr0", "0rgb", "0bgr", "rgb24", "bgr24", NULL
+    };
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--format=", 9) == 0) {
+            opts.format = arg + 9;
+            int i = 0;
+            while (formats[i] && strcmp(formats[i], opts.format))
+                i++;
+            if (!formats[i])
+                die("unknown format");
+        } else if (strncmp(arg, "--size=", 7) == 0) {
+            if (sscanf(arg + 7, "%dx%d", &opts.w, &opts.h) != 2 ||
+                opts.w < 1 || opts.h < 1)
+                die("invalid --size");
+        } else if (strncmp(arg, "--output=", 9) == 0) {
+            opts.output = arg + 9;
+        } else if (strncmp(arg, "--buffers=", 10) == 0) {
+            opts.buffers = atoi(arg + 10);
+            if (opts.buffers < 2)
+                die("--buffers must be at least 2");
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: sw-export [options] file");
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    // A closed pipe should make writev() fail, not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    if (opts.output) {
+        // Blocks until there's a reader if it's a FIFO.
+        out_fd = open(opts.output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+        if (out_fd < 0)
+            die("could not open output");
+    }
+#ifdef F_SETPIPE_SZ
+    // Bigger pipe buffers mean fewer context switches with the reader. This
+    // fails harmlessly if the output is not a pipe.
+    fcntl(out_fd, F_SETPIPE_SZ, 1 << 20);
+#endif
+
+    struct sw_source src;
+    if (sw_source_init(&src, opts.options) < 0)
+        die("mpv init failed");
+    mpv = src.mpv;
+
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    if (mpv_command(mpv, cmd) < 0)
+        die("loadfile failed");
+
+    const char *format = strcmp(opts.format, "y4m") ? opts.format : "rgb0";
+    const char *error = NULL;
+    pthread_t writer;
+    bool writer_started = false;
+    double start = now_seconds();
+
+    while (!error) {
+        mpv_event *event = sw_source_wait(&src, -1);
+        if (!event) {
+            if (!writer_started) {
+                setup_output(&src, &writer);
+                writer_started = true;
+            }
+            pthread_mutex_lock(&ring.lock);
+            if (ring.count == opts.buffers)
+                stats.full_waits++;
+            while (ring.count == opts.buffers && !ring.failed)
+                pthread_cond_wait(&ring.cond, &ring.lock);
+            bool failed = ring.failed;
+            struct frame_buf *buf = &ring.bufs[ring.head];
+            pthread_mutex_unlock(&ring.lock);
+            if (failed) {
+                error = "write error";
+                // Still consume the frame, so the VO doesn't wait for it.
+                sw_source_render(&src, out_w, out_h, format, NULL, stride);
+                break;
+            }
+
+            int r = sw_source_render(&src, out_w, out_h, format, buf->pixels,
+                                     stride);
+            if (r < 0) {
+                error = mpv_error_string(r);
+                break;
+            }
+
+            pthread_mutex_lock(&ring.lock);
+            ring.head = (ring.head + 1) % opts.buffers;
+            ring.count++;
+            stats.frames++;
+            if (!ring.paused && ring.count >= opts.buffers * 3 / 4) {
+                ring.paused = true;
+                stats.pauses++;
+                mpv_set_property_async(mpv, 0, "pause", MPV_FORMAT_FLAG,
+                                       &(int){1});
+            }
+            pthread_cond_broadcast(&ring.cond);
+            pthread_mutex_unlock(&ring.lock);
+        } else if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = event->data;
+            if (ef->reason == MPV_END_FILE_REASON_ERROR)
+                error = mpv_error_string(ef->error);
+            break;
+        } else if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            break;
+        }
+    }
+
+    int64_t dropped = 0;
+    mpv_get_property(mpv, "frame-drop-count", MPV_FORMAT_INT64, &dropped);
+
+    if (writer_started) {
+        pthread_mutex_lock(&ring.lock);
+        ring.eof = true;
+        pthread_cond_broadcast(&ring.cond);
+        pthread_mutex_unlock(&ring.lock);
+        pthread_join(writer, NULL);
+        if (ring.failed && !error)
+            error = "write error";
+    }
+
+    sw_source_destroy(&src);
+
+    double secs = now_seconds() - start;
+    fprintf(stderr, "frames: %" PRId64 " (%dx%d %s), %.3f s, %.1f fps, "
+            "%.1f MiB/s\n", stats.frames, out_w, out_h, opts.format, secs,
+            stats.frames / secs, stats.bytes / secs / (1 << 20));
+    fprintf(stderr, "writes: %" PRId64 ", pauses: %" PRId64 ", ring full: %"
+            PRId64 ", dropped by VO: %" PRId64 "\n", stats.writes,
+            stats.pauses, stats.full_waits, dropped);
+
+    if (ring.bufs) {
+        for (int n = 0; n < opts.buffers; n++) {
+            free(ring.bufs[n].mem);
+            free(ring.bufs[n].planar);
+        }
+        free(ring.bufs);
+    }
+    if (opts.output)
+        close(out_fd);
+
+    if (error) {
+        fprintf(stderr, "error: %s\n", error);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+// Build with: gcc -o swformat-bench swformat-bench.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Benchmark of the render API's software renderer for every output format
+// (MPV_RENDER_PARAM_SW_FORMAT) and pointer/stride alignment. It decodes one
+// frame, and then renders that same frame over and over for each combination
+// (mpv_render_context_render() renders the current frame again if there is no
+// new one), so the times are only the conversion, scaling and packing done by
+// the renderer, without decoding. A JSON object with the results is printed
+// to stdout.
+//
+// render.h asks for 64 byte alignment of both the pointer and the stride, and
+// warns that less alignment may take slower code paths, up to copying the whole
+// frame. With an alignment of N, the pointer is aligned to exactly N bytes
+// (not 2*N), and the stride is the line size rounded up to a multiple of N; an
+// alignment of 1 means a tightly packed image at an odd address.
+//
+// Usage:
+//
+//   swformat-bench [options] file
+//
+//   --size=WxH        render size (default: display size of the video); a
+//                     different size adds scaling to the measured work
+//   --start=SECONDS   take the frame from this position (default 0)
+//   --align=LIST      comma separated alignments in bytes, powers of 2 up to
+//                     4096 (default: 1,4,16,32,64)
+//   --frames=N        timed renders per combination (default 50)
+//   --warmup=N        untimed renders before that (default 3)
+//   --set=NAME=VALUE  set an mpv option before initialization (can be
+//                     repeated), e.g. --set=sws-scaler=fast-bilinear
+
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mpv/client.h>
+#include <mpv/render.h>
+
+// For struct sw_source. Also pulls in headers.
+#include "sw_source.inc"
+
+#define MAX_OPTIONS 64
+#define MAX_ALIGNS 16
+#define MAX_ALIGN 4096
+
+static const struct {
+    const char *name;
+    int bytes;
+} formats[] = {
+    {"rgb0",    4},
+    {"bgr0",    4},
+    {"0rgb",    4},
+    {"0bgr",    4},
+    {"rgb24",   3},
+    {"bgr24",   3},
+};
+
+#define NUM_FORMATS ((int)(sizeof(formats) / sizeof(formats[0])))
+
+static struct {
+    const char *path;
+    int w, h;
+    const char *start;
+    int aligns[MAX_ALIGNS];
+    int num_aligns;
+    int frames;
+    int warmup;
+    const char *options[MAX_OPTIONS];
+    int num_options;
+} opts = {
+    .start = "0",
+    .aligns = {1, 4, 16, 32, 64},
+    .num_aligns = 5,
+    .frames = 50,
+    .warmup = 3,
+};
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : da > db;
+}
+
+static void parse_aligns(const char *s)
+{
+    opts.num_aligns = 0;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > MAX_ALIGN || (v & (v - 1)) ||
+            opts.num_aligns == MAX_ALIGNS)
+            die("invalid --align");
+        opts.aligns[opts.num_aligns++] = v;
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            die("invalid --align");
+    }
+    if (!opts.num_aligns)
+        die("invalid --align");
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--size=", 7) == 0) {
+            if (sscanf(arg + 7, "%dx%d", &opts.w, &opts.h) != 2 ||
+                opts.w < 1 || opts.h < 1)
+                die("invalid --size");
+        } else if (strncmp(arg, "--start=", 8) == 0) {
+            opts.start = arg + 8;
+        } else if (strncmp(arg, "--align=", 8) == 0) {
+            parse_aligns(arg + 8);
+        } else if (strncmp(arg, "--frames=", 9) == 0) {
+            opts.frames = atoi(arg + 9);
+            if (opts.frames < 1)
+                die("invalid --frames");
+        } else if (strncmp(arg, "--warmup=", 9) == 0) {
+            opts.warmup = atoi(arg + 9);
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: swformat-bench [options] file");
+}
+
+// Wait for the first frame and consume it, so it becomes the current frame.
+static void load_frame(struct sw_source *src)
+{
+    const char *cmd[] = {"loadfile", opts.path, NULL};
+    if (mpv_command(src->mpv, cmd) < 0)
+        die("loadfile failed");
+    while (1) {
+        mpv_event *event = sw_source_wait(src, 30);
+        if (!event)
+            break;
+        if (event->event_id == MPV_EVENT_NONE)
+            die("timeout");
+        if (event->event_id == MPV_EVENT_END_FILE)
+            die("no video frame");
+    }
+    if (!opts.w && !sw_source_video_size(src, &opts.w, &opts.h))
+        die("no video");
+    if (sw_source_render(src, opts.w, opts.h, "rgb0", NULL, 0) < 0)
+        die("render failed");
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    // Keep the first frame around; --set options can override these.
+    char start[64];
+    snprintf(start, sizeof(start), "start=%s", opts.start);
+    const char *options[MAX_OPTIONS + 4] = {
+        "pause=yes", "keep-open=yes", start,
+    };
+    for (int n = 0; n < opts.num_options; n++)
+        options[3 + n] = opts.options[n];
+
+    struct sw_source src;
+    if (sw_source_init(&src, options) < 0)
+        die("mpv init failed");
+    load_frame(&src);
+
+    // Large enough for any combination: the widest line, rounded up, plus the
+    // pointer offset.
+    size_t max_stride = ((size_t)opts.w * 4 + MAX_ALIGN - 1) &
+                        ~(size_t)(MAX_ALIGN - 1);
+    size_t mem_size = max_stride * opts.h + 2 * MAX_ALIGN;
+    char *mem = malloc(mem_size);
+    double *times = malloc(sizeof(double) * opts.frames);
+    if (!mem || !times)
+        die("out of memory");
+    // Touch all pages, so the first combination doesn't pay for faulting
+    // them in.
+    memset(mem, 0, mem_size);
+    char *base = (char *)(((uintptr_t)mem + MAX_ALIGN - 1) &
+                          ~(uintptr_t)(MAX_ALIGN - 1));
+
+    FILE *f = stdout;
+    fprintf(f, "{\n  \"file\": ");
+    write_json_string(f, opts.path);
+    fprintf(f, ",\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n"
+            "  \"results\": [", opts.w, opts.h, opts.frames);
+
+    for (int i = 0; i < NUM_FORMATS; i++) {
+        for (int j = 0; j < opts.num_aligns; j++) {
+            int align = opts.aligns[j];
+            size_t line = (size_t)opts.w * formats[i].bytes;
+            size_t stride = (line + align - 1) & ~(size_t)(align - 1);
+            // Exactly align-aligned: base is MAX_ALIGN aligned.
+            char *pixels = base + (align < MAX_ALIGN ? align : 0);
+
+            fprintf(f, "%s\n    {\"format\": \"%s\", \"align\": %d, "
+                    "\"stride\": %zu", i || j ? "," : "", formats[i].name,
+                    align, stride);
+
+            int r = 0;
+            for (int n = 0; n < opts.warmup && r >= 0; n++) {
+                r = sw_source_render(&src, opts.w, opts.h, formats[i].name,
+                                     pixels, stride);
+            }
+            for (int n = 0; n < opts.frames && r >= 0; n++) {
+                double t = now_seconds();
+                r = sw_source_render(&src, opts.w, opts.h, formats[i].name,
+                                     pixels, stride);
+                times[n] = now_seconds() - t;
+            }
+            if (r < 0) {
+                fprintf(f, ", \"error\": \"%s\"}", mpv_error_string(r));
+                continue;
+            }
+
+            double sum = 0;
+            for (int n = 0; n < opts.frames; n++)
+                sum += times[n];
+            qsort(times, opts.frames, sizeof(double), compare_double);
+            double median = times[opts.frames / 2];
+            fprintf(f, ", \"min_ms\": %.3f, \"median_ms\": %.3f, "
+                    "\"mean_ms\": %.3f, \"mpixels_per_s\": %.1f, "
+                    "\"gbytes_per_s\": %.3f}", times[0] * 1e3, median * 1e3,
+                    sum / opts.frames * 1e3,
+                    (double)opts.w * opts.h / median / 1e6,
+                    (double)line * opts.h / median / 1e9);
+            fflush(f);
+        }
+    }
+    fprintf(f, "\n  ]\n}\n");
+
+    free(times);
+    free(mem);
+    sw_source_destroy(&src);
+    return 0;
+}
@@ -0,0 +1,459 @@
+// Build with: gcc -o thumbfarm thumbfarm.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Multi-core thumbnailer. Creates one headless mpv instance per core (see
+// sw_source.inc), and renders a sprite sheet of evenly spaced thumbnails for
+// each file. The instances are kept for the whole run: moving to the next
+// file is a "loadfile", not a new process or mpv handle.
+//
+// Usage:
+//
+//   thumbfarm [options] file...
+//
+//   --count=N         thumbnails per file (default 16)
+//   --cols=N          thumbnails per sprite sheet row (default 4)
+//   --width=N         thumbnail width; the height follows from the video's
+//                     aspect ratio (default 160)
+//   --outdir=DIR      where to write the sprite sheets (default: .)
+//   --workers=N       number of mpv instances (default: number of CPUs)
+//   --timeout=SECONDS give up on a thumbnail after this long (default 10)
+//   --set=NAME=VALUE  set an mpv option on each instance (can be repeated)
+//
+// Each sprite sheet is written as <outdir>/<file name>.ppm (binary PPM, which
+// anything can convert). Thumbnails that failed are left black. Statistics are
+// printed as JSON to stdout.
+//
+// A job is one thumbnail: a file and a position in percent. Each worker has a
+// deque of jobs. Initially, files are dealt out round-robin, and all jobs of a
+// file go to the same worker, which works on them front to back, so the file
+// is loaded once, and each thumbnail is a paused seek. A worker that runs out
+// of jobs steals from the back of another worker's deque: half of that
+// worker's jobs, but only from its last file, so that both have to load as few
+// files as possible. Decoders are limited to one thread each, since the
+// workers already keep all cores busy.
+//
+// Thumbnails are rendered directly into their tile of the sprite sheet; the
+// workers working on the same file share it.
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mpv/client.h>
+#include <mpv/render.h>
+
+// For struct sw_source. Also pulls in headers.
+#include "sw_source.inc"
+
+#define MAX_OPTIONS 64
+
+static struct {
+    int count;
+    int cols;
+    int width;
+    const char *outdir;
+    int workers;
+    double timeout;
+    const char *options[MAX_OPTIONS + 1];
+    int num_options;
+    char **files;
+    int num_files;
+} opts = {
+    .count = 16,
+    .cols = 4,
+    .width = 160,
+    .outdir = ".",
+    .timeout = 10,
+};
+
+struct file_entry {
+    const char *path;
+    pthread_mutex_t lock;
+    // Set up by the first worker that loaded the file. The sheet is RGB0.
+    int tile_w, tile_h;
+    uint8_t *sheet;
+    size_t stride;
+    // Jobs not finished yet; the worker finishing the last one writes the
+    // sprite sheet.
+    int remaining;
+    int failed;
+};
+
+struct job {
+    int file;
+    int index;
+};
+
+struct worker {
+    pthread_t thread;
+    struct sw_source src;
+    // Deque of jobs. The owner takes from the front, thieves from the back.
+    pthread_mutex_t lock;
+    struct job *jobs;
+    int first, num;
+    // File currently loaded in src, or -1.
+    int loaded;
+    // Statistics.
+    int64_t done, failed, loads, steals, stolen_jobs;
+    double busy;
+};
+
+static struct file_entry *files;
+static struct worker *workers;
+static int num_workers;
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool pop_front(struct worker *w, struct job *job)
+{
+    pthread_mutex_lock(&w->lock);
+    bool ok = w->num > 0;
+    if (ok) {
+        *job = w->jobs[w->first++];
+        w->num--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+// Move up to half of the victim's jobs from the back of its deque to the
+// (empty) deque of thief, as long as they're for the same file.
+static int steal(struct worker *thief, struct worker *victim)
+{
+    pthread_mutex_lock(&victim->lock);
+    int num = 0;
+    if (victim->num > 0) {
+        int last = victim->first + victim->num - 1;
+        int file = victim->jobs[last].file;
+        int max = (victim->num + 1) / 2;
+        while (num < max && victim->jobs[last - num].file == file)
+            num++;
+        victim->num -= num;
+        // Nobody else reads the thief's jobs while its deque is empty.
+        memcpy(thief->jobs, victim->jobs + victim->first + victim->num,
+               num * sizeof(struct job));
+    }
+    pthread_mutex_unlock(&victim->lock);
+    // Never hold two deque locks at once; thieves may steal from each other.
+    pthread_mutex_lock(&thief->lock);
+    thief->first = 0;
+    thief->num = num;
+    pthread_mutex_unlock(&thief->lock);
+    return num;
+}
+
+// Get the next job: own jobs first, then stolen ones. Jobs are never added,
+// so if all deques are empty, the work is done.
+static bool next_job(struct worker *w, struct job *job)
+{
+    if (pop_front(w, job))
+        return true;
+    int self = w - workers;
+    // Start with the next worker, so that thieves spread out.
+    for (int n = 1; n < num_workers; n++) {
+        struct worker *victim = &workers[(self + n) % num_workers];
+        int num = steal(w, victim);
+        if (num) {
+            w->steals++;
+            w->stolen_jobs += num;
+            return pop_front(w, job);
+        }
+    }
+    return false;
+}
+
+// Wait until the command issued last (a loadfile or seek while paused) has
+// finished, then render the frame it shows to pixels (unless NULL). Frames
+// reported before that may be left over from a previous command, so they're
+// skipped.
+static bool wait_for_frame(struct worker *w, uint8_t *pixels, int tw, int th,
+                           size_t stride)
+{
+    double deadline = now_seconds() + opts.timeout;
+    while (1) {
+        double left = deadline - now_seconds();
+        if (left <= 0)
+            return false;
+        mpv_event *event = sw_source_wait(&w->src, left);
+        if (!event) {
+            if (sw_source_render(&w->src, tw, th, "rgb0", NULL, stride) < 0)
+                return false;
+        } else if (event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+            break;
+        } else if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = event->data;
+            // The previous file being replaced by loadfile is expected.
+            if (ef->reason != MPV_END_FILE_REASON_STOP)
+                return false;
+        } else if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            return false;
+        }
+    }
+    // mpv only restarts playback once the first frame after the command has
+    // been shown (i.e. skipped above), and decodes nothing else while paused.
+    // So that frame is still the current one, and gets rendered again.
+    if (!pixels)
+        return true;
+    return sw_source_render(&w->src, tw, th, "rgb0", pixels, stride) >= 0;
+}
+
+// Load the job's file if it's not loaded yet, and set up its sprite sheet.
+static bool load_file(struct worker *w, struct file_entry *f, int file)
+{
+    if (w->loaded == file)
+        return true;
+    w->loaded = -1;
+    w->loads++;
+    const char *cmd[] = {"loadfile", f->path, NULL};
+    if (mpv_command(w->src.mpv, cmd) < 0)
+        return false;
+    // mpv shows the first frame even when paused. The thumbnail size isn't
+    // known yet, so it's skipped; any size works for that.
+    if (!wait_for_frame(w, NULL, 16, 16, 64))
+        return false;
+    int vw, vh;
+    if (!sw_source_video_size(&w->src, &vw, &vh))
+        return false;
+
+    pthread_mutex_lock(&f->lock);
+    bool ok = true;
+    if (!f->sheet) {
+        int rows = (opts.count + opts.cols - 1) / opts.cols;
+        f->tile_w = opts.width;
+        f->tile_h = ((int64_t)opts.width * vh / vw + 1) & ~1;
+        if (f->tile_h < 2)
+            f->tile_h = 2;
+        f->stride = (size_t)f->tile_w * opts.cols * 4;
+        f->sheet = calloc(rows * f->tile_h, f->stride);
+        ok = !!f->sheet;
+    }
+    pthread_mutex_unlock(&f->lock);
+    if (ok)
+        w->loaded = file;
+    return ok;
+}
+
+static bool run_job(struct worker *w, const struct job *job)
+{
+    struct file_entry *f = &files[job->file];
+    if (!load_file(w, f, job->file))
+        return false;
+
+    // Positions are the middle of N equal parts, so that neither the first
+    // frame (often black) nor the end of the file is used.
+    char pos[32];
+    snprintf(pos, sizeof(pos), "%f", (job->index + 0.5) * 100.0 / opts.count);
+    const char *cmd[] = {"seek", pos, "absolute-percent+exact", NULL};
+    if (mpv_command(w->src.mpv, cmd) < 0)
+        return false;
+
+    int col = job->index % opts.cols, row = job->index / opts.cols;
+    uint8_t *tile = f->sheet + row * f->tile_h * f->stride +
+                    col * f->tile_w * 4;
+    return wait_for_frame(w, tile, f->tile_w, f->tile_h, f->stride);
+}
+
+static void write_sheet(struct file_entry *f)
+{
+    if (!f->sheet)
+        return; // not even loaded once
+    const char *name = strrchr(f->path, '/');
+    name = name ? name + 1 : f->path;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.ppm", opts.outdir, name);
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "could not write %s\n", path);
+        return;
+    }
+    int w = f->tile_w * opts.cols;
+    int h = f->tile_h * ((opts.count + opts.cols - 1) / opts.cols);
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    uint8_t *line = malloc(w * 3);
+    for (int y = 0; line && y < h; y++) {
+        const uint8_t *src = f->sheet + y * f->stride;
+        for (int x = 0; x < w; x++)
+            memcpy(line + x * 3, src + x * 4, 3);
+        fwrite(line, w * 3, 1, fp);
+    }
+    free(line);
+    if (fclose(fp))
+        fprintf(stderr, "could not write %s\n", path);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct job job;
+    while (next_job(w, &job)) {
+        double start = now_seconds();
+        bool ok = run_job(w, &job);
+        w->busy += now_seconds() - start;
+        if (ok) {
+            w->done++;
+        } else {
+            w->failed++;
+            // The instance may be stuck in any state; reload next time.
+            w->loaded = -1;
+        }
+
+        struct file_entry *f = &files[job.file];
+        pthread_mutex_lock(&f->lock);
+        f->failed += !ok;
+        bool last = --f->remaining == 0;
+        pthread_mutex_unlock(&f->lock);
+        if (last) {
+            write_sheet(f);
+            free(f->sheet);
+            f->sheet = NULL;
+        }
+    }
+    return NULL;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int n = 1;
+    for (; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--count=", 8) == 0) {
+            opts.count = atoi(arg + 8);
+        } else if (strncmp(arg, "--cols=", 7) == 0) {
+            opts.cols = atoi(arg + 7);
+        } else if (strncmp(arg, "--width=", 8) == 0) {
+            opts.width = atoi(arg + 8);
+        } else if (strncmp(arg, "--outdir=", 9) == 0) {
+            opts.outdir = arg + 9;
+        } else if (strncmp(arg, "--workers=", 10) == 0) {
+            opts.workers = atoi(arg + 10);
+        } else if (strncmp(arg, "--timeout=", 10) == 0) {
+            opts.timeout = atof(arg + 10);
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else {
+            break;
+        }
+    }
+    opts.files = argv + n;
+    opts.num_files = argc - n;
+    if (!opts.num_files)
+        die("usage: thumbfarm [options] file...");
+    if (opts.count < 1 || opts.cols < 1 || opts.width < 2)
+        die("invalid --count, --cols or --width");
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    num_workers = opts.workers;
+    if (num_workers < 1)
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1)
+        num_workers = 1;
+    // More workers than files would only have them steal from each other.
+    if (num_workers > opts.num_files * opts.count)
+        num_workers = opts.num_files * opts.count;
+
+    int total = opts.num_files * opts.count;
+    files = calloc(opts.num_files, sizeof(files[0]));
+    workers = calloc(num_workers, sizeof(workers[0]));
+    if (!files || !workers)
+        die("out of memory");
+    for (int n = 0; n < opts.num_files; n++) {
+        files[n].path = opts.files[n];
+        files[n].remaining = opts.count;
+        pthread_mutex_init(&files[n].lock, NULL);
+    }
+
+    // Always paused: each thumbnail is a seek, which shows exactly one frame.
+    // keep-open stops seeks near the end from ending playback.
+    const char *base_options[] = {"pause=yes", "keep-open=yes",
+                                  "vd-lavc-threads=1", "hr-seek=yes"};
+    const char *options[MAX_OPTIONS + 5];
+    int num_options = 0;
+    for (int n = 0; n < 4; n++)
+        options[num_options++] = base_options[n];
+    for (int n = 0; n < opts.num_options; n++)
+        options[num_options++] = opts.options[n];
+    options[num_options] = NULL;
+
+    for (int n = 0; n < num_workers; n++) {
+        struct worker *w = &workers[n];
+        if (sw_source_init(&w->src, options) < 0)
+            die("mpv init failed");
+        pthread_mutex_init(&w->lock, NULL);
+        // A worker never holds more than all jobs.
+        w->jobs = calloc(total, sizeof(w->jobs[0]));
+        if (!w->jobs)
+            die("out of memory");
+        w->loaded = -1;
+    }
+    for (int n = 0; n < opts.num_files; n++) {
+        struct worker *w = &workers[n % num_workers];
+        for (int i = 0; i < opts.count; i++)
+            w->jobs[w->num++] = (struct job){n, i};
+    }
+
+    double start = now_seconds();
+    for (int n = 0; n < num_workers; n++) {
+        if (pthread_create(&workers[n].thread, NULL, worker_thread,
+                           &workers[n]))
+            die("could not create worker thread");
+    }
+    for (int n = 0; n < num_workers; n++)
+        pthread_join(workers[n].thread, NULL);
+    double secs = now_seconds() - start;
+
+    int64_t done = 0, failed = 0;
+    for (int n = 0; n < num_workers; n++) {
+        done += workers[n].done;
+        failed += workers[n].failed;
+    }
+    printf("{\"files\": %d, \"workers\": %d, \"thumbnails\": %" PRId64 ", "
+           "\"failed\": %" PRId64 ", \"seconds\": %.3f, "
+           "\"thumbnails_per_second\": %.2f, \"per_worker\": [",
+           opts.num_files, num_workers, done, failed, secs, done / secs);
+    for (int n = 0; n < num_workers; n++) {
+        struct worker *w = &workers[n];
+        printf("%s{\"thumbnails\": %" PRId64 ", \"failed\": %" PRId64 ", "
+               "\"loads\": %" PRId64 ", \"steals\": %" PRId64 ", "
+               "\"stolen_jobs\": %" PRId64 ", \"busy_seconds\": %.3f}",
+               n ? ", " : "", w->done, w->failed, w->loads, w->steals,
+               w->stolen_jobs, w->busy);
+    }
+    printf("]}\n");
+
+    for (int n = 0; n < num_workers; n++) {
+        sw_source_destroy(&workers[n].src);
+        pthread_mutex_destroy(&workers[n].lock);
+        free(workers[n].jobs);
+    }
+    for (int n = 0; n < opts.num_files; n++)
+        pthread_mutex_destroy(&files[n].lock);
+    free(workers);
+    free(files);
+    return failed ? 1 : 0;
+}
@@ -67,7 +67,9 @@ public:
 
             if (mpv_render_context_create(&obj->mpv_gl, obj->mpv, params) < 0)
                 throw std::runtime_error("failed to initialize mpv GL context");
-            mpv_render_context_set_update_callback(obj->mpv_gl, on_mpv_redraw, obj);
+            wakeup_coalescer_init(&obj->update_wakeup, on_mpv_redraw, obj);
+            mpv_render_context_set_update_callback(obj->mpv_gl, wakeup_coalescer_notify,
+                                                   &obj->update_wakeup);
         }
 
         return QQuickFramebufferObject::Renderer::createFramebufferObject(size);
@@ -138,6 +140,7 @@ void MpvObject::on_update(void *ctx)
 // connected to onUpdate(); signal makes sure it runs on the GUI thread
 void MpvObject::doUpdate()
 {
+    wakeup_coalescer_begin(&update_wakeup);
     update();
 }
 
@@ -6,6 +6,7 @@
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 #include "../common/qthelper.hpp"
+#include "../common/wakeup_coalescer.h"
 
 class MpvRenderer;
 
@@ -15,6 +16,8 @@ class MpvObject : public QQuickFramebufferObject
 
     mpv_handle *mpv;
     mpv_render_context *mpv_gl;
+    // Makes sure there's at most one queued onUpdate signal.
+    wakeup_coalescer update_wakeup;
 
     friend class MpvRenderer;
 
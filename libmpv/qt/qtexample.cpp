@@ -27,6 +27,8 @@ static void wakeup(void *ctx)
     // recursively from a thread that is calling the mpv API). Just notify
     // the Qt GUI thread to wake up (so that it can process events with
     // mpv_wait_event()), and return as quickly as possible.
+    // It goes through the wakeup_coalescer, so it's only called if the GUI
+    // thread doesn't already have a wakeup pending.
     MainWindow *mainwindow = (MainWindow *)ctx;
     emit mainwindow->mpv_events();
 }
@@ -102,7 +104,8 @@ MainWindow::MainWindow(QWidget *parent) :
     // relay the wakeup in a thread-safe way.
     connect(this, &MainWindow::mpv_events, this, &MainWindow::on_mpv_events,
             Qt::QueuedConnection);
-    mpv_set_wakeup_callback(mpv, wakeup, this);
+    wakeup_coalescer_init(&coalescer, wakeup, this);
+    mpv_set_wakeup_callback(mpv, wakeup_coalescer_notify, &coalescer);
 
     if (mpv_initialize(mpv) < 0)
         throw std::runtime_error("mpv failed to initialize");
@@ -178,6 +181,7 @@ void MainWindow::handle_mpv_event(mpv_event *event)
 // This slot is invoked by wakeup() (through the mpv_events signal).
 void MainWindow::on_mpv_events()
 {
+    wakeup_coalescer_begin(&coalescer);
     // Process all events, until the event queue is empty.
     while (mpv) {
         mpv_event *event = mpv_wait_event(mpv, 0);
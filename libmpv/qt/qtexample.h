@@ -5,6 +5,8 @@
 
 #include <mpv/client.h>
 
+#include "../common/wakeup_coalescer.h"
+
 class QTextEdit;
 
 class MainWindow : public QMainWindow
@@ -27,6 +29,8 @@ private:
     QWidget *mpv_container;
     mpv_handle *mpv;
     QTextEdit *log;
+    // Makes sure there's at most one queued mpv_events signal.
+    wakeup_coalescer coalescer;
 
     void append_log(const QString &text);
 
@@ -1,6 +1,9 @@
 ﻿#include "mpvwidget.h"
 #include <stdexcept>
 #include <QtGui/QOpenGLContext>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QMetaObject>
 
 static void wakeup(void *ctx)
@@ -17,8 +20,12 @@ static void *get_proc_address(void *ctx, const char *name) {
 }
 
 MpvWidget::MpvWidget(QWidget *parent, Qt::WindowFlags f)
-    : QOpenGLWidget(parent, f)
+    : QOpenGLWidget(parent, f), display_sync(false), painted(false),
+      new_frame(false)
 {
+    display_sync = QCoreApplication::arguments().contains("--display-sync");
+    vsync_stats_init(&vsync, 0, display_sync);
+
     mpv = mpv_create();
     if (!mpv)
         throw std::runtime_error("could not create mpv context");
@@ -26,6 +33,8 @@ MpvWidget::MpvWidget(QWidget *parent, Qt::WindowFlags f)
     mpv_set_option_string(mpv, "terminal", "yes");
     mpv_set_option_string(mpv, "msg-level", "all=v");
     mpv_set_option_string(mpv, "vo", "libmpv");
+    if (display_sync)
+        mpv_set_option_string(mpv, "video-sync", "display-resample");
     if (mpv_initialize(mpv) < 0)
         throw std::runtime_error("could not initialize mpv context");
 
@@ -34,11 +43,18 @@ MpvWidget::MpvWidget(QWidget *parent, Qt::WindowFlags f)
 
     mpv_observe_property(mpv, 0, "duration", MPV_FORMAT_DOUBLE);
     mpv_observe_property(mpv, 0, "time-pos", MPV_FORMAT_DOUBLE);
-    mpv_set_wakeup_callback(mpv, wakeup, this);
+    mpv_observe_property(mpv, 0, "container-fps", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(mpv, 0, "pause", MPV_FORMAT_FLAG);
+    wakeup_coalescer_init(&events_wakeup, wakeup, this);
+    mpv_set_wakeup_callback(mpv, wakeup_coalescer_notify, &events_wakeup);
+    // QOpenGLWidget has no swap of its own, but this is emitted after the
+    // window it's composited into was swapped.
+    connect(this, &QOpenGLWidget::frameSwapped, this, &MpvWidget::swapped);
 }
 
 MpvWidget::~MpvWidget()
 {
+    vsync_stats_save(&vsync, "vsync-stats.json");
     makeCurrent();
     if (mpv_gl)
         mpv_render_context_free(mpv_gl);
@@ -71,7 +87,20 @@ void MpvWidget::initializeGL()
 
     if (mpv_render_context_create(&mpv_gl, mpv, params) < 0)
         throw std::runtime_error("failed to initialize mpv GL context");
-    mpv_render_context_set_update_callback(mpv_gl, MpvWidget::on_update, reinterpret_cast<void *>(this));
+
+    // The refresh rate of the screen the window is on. mpv can't query it
+    // for a window it doesn't own. (The option was called override-display-fps
+    // before mpv 0.37; setting the other name just fails.)
+    QScreen *screen = window()->windowHandle()
+                      ? window()->windowHandle()->screen() : nullptr;
+    double display_fps = screen ? screen->refreshRate() : 0;
+    vsync_stats_init(&vsync, display_fps, display_sync);
+    if (display_sync && display_fps > 0) {
+        mpv_set_property(mpv, "display-fps-override", MPV_FORMAT_DOUBLE, &display_fps);
+        mpv_set_property(mpv, "override-display-fps", MPV_FORMAT_DOUBLE, &display_fps);
+    }
+    wakeup_coalescer_init(&update_wakeup, MpvWidget::on_update, this);
+    mpv_render_context_set_update_callback(mpv_gl, wakeup_coalescer_notify, &update_wakeup);
 }
 
 void MpvWidget::paintGL()
@@ -79,18 +108,44 @@ void MpvWidget::paintGL()
     mpv_opengl_fbo mpfbo{static_cast<int>(defaultFramebufferObject()), width(), height(), 0};
     int flip_y{1};
 
+    // Wait until the frame's target time before rendering it, so that the
+    // following swap presents it on the right vsync. This is the default, but
+    // it's essential for display-sync mode.
+    int block_for_target{1};
+
     mpv_render_param params[] = {
         {MPV_RENDER_PARAM_OPENGL_FBO, &mpfbo},
         {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block_for_target},
         {MPV_RENDER_PARAM_INVALID, nullptr}
     };
+    mpv_render_frame_info info{};
+    mpv_render_context_get_info(mpv_gl, {MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info});
+    new_frame = (info.flags & MPV_RENDER_FRAME_INFO_PRESENT) &&
+                !(info.flags & (MPV_RENDER_FRAME_INFO_REDRAW |
+                                MPV_RENDER_FRAME_INFO_REPEAT));
     // See render_gl.h on what OpenGL environment mpv expects, and
     // other API details.
     mpv_render_context_render(mpv_gl, params);
+    painted = true;
+}
+
+// Called after each swap of the window. Other widgets (like the slider) cause
+// swaps too, without paintGL() running; those don't present anything of mpv's.
+void MpvWidget::swapped()
+{
+    if (!painted)
+        return;
+    painted = false;
+    if (display_sync)
+        mpv_render_context_report_swap(mpv_gl);
+    vsync_stats_swap(&vsync, mpv_get_time_us(mpv), new_frame);
+    new_frame = false;
 }
 
 void MpvWidget::on_mpv_events()
 {
+    wakeup_coalescer_begin(&events_wakeup);
     // Process all events, until the event queue is empty.
     while (mpv) {
         mpv_event *event = mpv_wait_event(mpv, 0);
@@ -106,7 +161,13 @@ void MpvWidget::handle_mpv_event(mpv_event *event)
     switch (event->event_id) {
     case MPV_EVENT_PROPERTY_CHANGE: {
         mpv_event_property *prop = (mpv_event_property *)event->data;
-        if (strcmp(prop->name, "time-pos") == 0) {
+        if (strcmp(prop->name, "container-fps") == 0) {
+            vsync_stats_set_fps(&vsync, prop->format == MPV_FORMAT_DOUBLE
+                                        ? *(double *)prop->data : 0);
+        } else if (strcmp(prop->name, "pause") == 0) {
+            // Don't count the time spent paused as a long frame.
+            vsync_stats_reset(&vsync);
+        } else if (strcmp(prop->name, "time-pos") == 0) {
             if (prop->format == MPV_FORMAT_DOUBLE) {
                 double time = *(double *)prop->data;
                 Q_EMIT positionChanged(time);
@@ -127,6 +188,7 @@ void MpvWidget::handle_mpv_event(mpv_event *event)
 // Make Qt invoke mpv_render_context_render() to draw a new/updated video frame.
 void MpvWidget::maybeUpdate()
 {
+    wakeup_coalescer_begin(&update_wakeup);
     // If the Qt window is not visible, Qt's update() will just skip rendering.
     // This confuses mpv's render API, and may lead to small occasional
     // freezes due to video rendering timing out.
@@ -138,6 +200,7 @@ void MpvWidget::maybeUpdate()
         makeCurrent();
         paintGL();
         context()->swapBuffers(context()->surface());
+        swapped();
         doneCurrent();
     } else {
         update();
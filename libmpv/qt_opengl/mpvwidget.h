@@ -5,6 +5,8 @@
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 #include "../common/qthelper.hpp"
+#include "../common/vsync_stats.h"
+#include "../common/wakeup_coalescer.h"
 
 class MpvWidget Q_DECL_FINAL: public QOpenGLWidget
 {
@@ -25,12 +27,24 @@ protected:
 private Q_SLOTS:
     void on_mpv_events();
     void maybeUpdate();
+    void swapped();
 private:
     void handle_mpv_event(mpv_event *event);
     static void on_update(void *ctx);
 
     mpv_handle *mpv;
     mpv_render_context *mpv_gl;
+    // Make sure there's at most one queued call of on_mpv_events() and
+    // maybeUpdate() each.
+    wakeup_coalescer events_wakeup;
+    wakeup_coalescer update_wakeup;
+    // Started with --display-sync: mpv times video against the display.
+    bool display_sync;
+    // paintGL() ran since the last swap, and whether it rendered a new video
+    // frame.
+    bool painted;
+    bool new_frame;
+    vsync_stats vsync;
 };
 
 
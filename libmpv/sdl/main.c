@@ -1,16 +1,71 @@
 // Build with: gcc -o main main.c `pkg-config --libs --cflags mpv sdl2` -std=c99
+//
+// Usage: main [--display-sync] [--render-thread] file
+//
+// With --display-sync, mpv times video against the display instead of the
+// audio clock (video-sync=display-resample): it's told the refresh rate, vsync
+// is enabled, each swap is reported with mpv_render_context_report_swap(),
+// and rendering blocks until the frame's target time. Present timing (missed
+// and duplicated vsyncs, see common/vsync_stats.h) is written to
+// vsync-stats.json on exit in either mode.
+//
+// By default, everything happens on the main thread, so a swap that blocks
+// until vsync also delays input and mpv event handling. With --render-thread,
+// the GL context is moved to a separate thread, which is woken up by the render
+// update callback and does all mpv_render_context_*() calls and swaps, while
+// the main thread only handles SDL and mpv events. (Swapping on another thread
+// works with most SDL video drivers, but not on macOS.)
+//
+// Press h to toggle a HUD with render timing statistics (see render_stats.inc).
+// The statistics are written to render-stats.json on exit.
 
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <SDL.h>
 
 #include <mpv/client.h>
 #include <mpv/render_gl.h>
 
+#include "../common/vsync_stats.h"
+#include "../common/wakeup_coalescer.h"
+
+#include "render_stats.inc"
+
 static Uint32 wakeup_on_mpv_render_update, wakeup_on_mpv_events;
 
+// At most one SDL event of each type is queued at a time.
+static struct wakeup_coalescer render_update_wakeup, events_wakeup;
+
+static SDL_Window *window;
+static SDL_GLContext glcontext;
+static mpv_handle *mpv;
+static mpv_render_context *mpv_gl;
+static int display_sync;
+
+// State shared between the main thread and the render thread (if any).
+static struct {
+    SDL_mutex *lock;
+    SDL_cond *wakeup;
+    // Size to render at.
+    int w, h;
+    // mpv_render_context_update() needs to be called.
+    int update;
+    // Render even if mpv has no new frame (e.g. the window was exposed).
+    int redraw;
+    int quit;
+    // The render context was created.
+    int ready;
+    // GL_RENDERER, to tell results from different machines apart.
+    char gl_renderer[128];
+    // Written by whoever renders, but the main thread resets the vsync stats
+    // and toggles the HUD.
+    struct render_stats stats;
+    struct vsync_stats vsync;
+} rt;
+
 static void die(const char *msg)
 {
     fprintf(stderr, "%s\n", msg);
@@ -22,28 +77,169 @@ static void *get_proc_address_mpv(void *fn_ctx, const char *name)
     return SDL_GL_GetProcAddress(name);
 }
 
-static void on_mpv_events(void *ctx)
+static void push_event(void *ctx)
 {
-    SDL_Event event = {.type = wakeup_on_mpv_events};
+    SDL_Event event = {.type = *(Uint32 *)ctx};
     SDL_PushEvent(&event);
 }
 
+// With --render-thread, the render update callback. It's already called only
+// once per wakeup of the render thread, so it doesn't need coalescing.
 static void on_mpv_render_update(void *ctx)
 {
-    SDL_Event event = {.type = wakeup_on_mpv_render_update};
-    SDL_PushEvent(&event);
+    SDL_LockMutex(rt.lock);
+    rt.update = 1;
+    SDL_CondSignal(rt.wakeup);
+    SDL_UnlockMutex(rt.lock);
+}
+
+// Create the mpv render context on the GL context that is current.
+static void create_render_context(void)
+{
+    const unsigned char *(*get_string)(unsigned int) =
+        (const unsigned char *(*)(unsigned int))
+            SDL_GL_GetProcAddress("glGetString");
+    const char *gl_renderer = get_string ? (char *)get_string(0x1F01) : NULL;
+    snprintf(rt.gl_renderer, sizeof(rt.gl_renderer), "%s",
+             gl_renderer ? gl_renderer : "opengl");
+
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_OPENGL},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &(mpv_opengl_init_params){
+            .get_proc_address = get_proc_address_mpv,
+        }},
+        // Tell libmpv that you will call mpv_render_context_update() on render
+        // context update callbacks, and that you will _not_ block on the core
+        // ever (see <libmpv/render.h> "Threading" section for what libmpv
+        // functions you can call at all when this is active).
+        // In particular, this means you must call e.g. mpv_command_async()
+        // instead of mpv_command().
+        // If you want to use synchronous calls, either make them on a separate
+        // thread, or remove the option below (this will disable features like
+        // DR and is not recommended anyway).
+        {MPV_RENDER_PARAM_ADVANCED_CONTROL, &(int){1}},
+        {0}
+    };
+
+    // This makes mpv use the currently set GL context. It will use the callback
+    // (passed via params) to resolve GL builtin functions, as well as extensions.
+    if (mpv_render_context_create(&mpv_gl, mpv, params) < 0)
+        die("failed to initialize mpv GL context");
+}
+
+// Render the current video frame at w x h, and swap. Called by whichever
+// thread has the GL context current.
+static void render(int w, int h)
+{
+    mpv_render_param params[] = {
+        // Specify the default framebuffer (0) as target. This will
+        // render onto the entire screen. If you want to show the video
+        // in a smaller rectangle or apply fancy transformations, you'll
+        // need to render into a separate FBO and draw it manually.
+        {MPV_RENDER_PARAM_OPENGL_FBO, &(mpv_opengl_fbo){
+            .fbo = 0,
+            .w = w,
+            .h = h,
+        }},
+        // Flip rendering (needed due to flipped GL coordinate system).
+        {MPV_RENDER_PARAM_FLIP_Y, &(int){1}},
+        // Wait until the frame's target time before rendering it, so
+        // that the following swap presents it on the right vsync. This
+        // is the default, but it's essential for display-sync mode.
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &(int){1}},
+        {0}
+    };
+    mpv_render_frame_info info = {0};
+    mpv_render_context_get_info(mpv_gl, (mpv_render_param){
+        MPV_RENDER_PARAM_NEXT_FRAME_INFO, &info});
+    int64_t t0 = rs_now();
+    // See render_gl.h on what OpenGL environment mpv expects, and
+    // other API details.
+    mpv_render_context_render(mpv_gl, params);
+    int64_t t1 = rs_now();
+    SDL_GL_SwapWindow(window);
+    int64_t t2 = rs_now();
+    // Tell mpv when the frame was actually presented (approximately:
+    // SDL_GL_SwapWindow() returns after the vsync with most drivers).
+    if (display_sync)
+        mpv_render_context_report_swap(mpv_gl);
+    SDL_LockMutex(rt.lock);
+    vsync_stats_swap(&rt.vsync, mpv_get_time_us(mpv),
+                     (info.flags & MPV_RENDER_FRAME_INFO_PRESENT) &&
+                     !(info.flags & (MPV_RENDER_FRAME_INFO_REDRAW |
+                                     MPV_RENDER_FRAME_INFO_REPEAT)));
+    rs_add_render(&rt.stats, &info, t1 - t0);
+    rs_add(&rt.stats, RS_PRESENT, t2 - t1);
+    rs_add(&rt.stats, RS_FRAME, t2 - t0);
+    rs_update_hud(&rt.stats, mpv, 0);
+    SDL_UnlockMutex(rt.lock);
+}
+
+// With --render-thread, the only thread that uses the GL context, from
+// creating the render context to freeing it.
+static int render_thread(void *ctx)
+{
+    if (SDL_GL_MakeCurrent(window, glcontext) < 0)
+        die("could not make the GL context current on the render thread");
+    create_render_context();
+    mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, NULL);
+
+    SDL_LockMutex(rt.lock);
+    rt.ready = 1;
+    SDL_CondSignal(rt.wakeup);
+    while (1) {
+        while (!rt.quit && !rt.update && !rt.redraw)
+            SDL_CondWait(rt.wakeup, rt.lock);
+        if (rt.quit)
+            break;
+        int update = rt.update, redraw = rt.redraw;
+        int w = rt.w, h = rt.h;
+        rt.update = rt.redraw = 0;
+        SDL_UnlockMutex(rt.lock);
+
+        if (update && (mpv_render_context_update(mpv_gl) &
+                       MPV_RENDER_UPDATE_FRAME))
+            redraw = 1;
+        if (redraw)
+            render(w, h);
+
+        SDL_LockMutex(rt.lock);
+    }
+    SDL_UnlockMutex(rt.lock);
+
+    // Destroy the GL renderer and all of the GL objects it allocated. If video
+    // is still running, the video track will be deselected.
+    mpv_render_context_free(mpv_gl);
+    SDL_GL_MakeCurrent(window, NULL);
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
-        die("pass a single media file as argument");
+    const char *file = NULL;
+    int use_render_thread = 0;
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "--display-sync") == 0) {
+            display_sync = 1;
+        } else if (strcmp(argv[n], "--render-thread") == 0) {
+            use_render_thread = 1;
+        } else if (!file) {
+            file = argv[n];
+        } else {
+            file = NULL;
+            break;
+        }
+    }
+    if (!file)
+        die("usage: main [--display-sync] [--render-thread] file");
 
-    mpv_handle *mpv = mpv_create();
+    mpv = mpv_create();
     if (!mpv)
         die("context init failed");
 
     mpv_set_option_string(mpv, "vo", "libmpv");
+    if (display_sync)
+        mpv_set_option_string(mpv, "video-sync", "display-resample");
 
     // Some minor options can only be set before mpv_initialize().
     if (mpv_initialize(mpv) < 0)
@@ -57,40 +253,66 @@ int main(int argc, char *argv[])
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
         die("SDL init failed");
 
-    SDL_Window *window =
+    window =
         SDL_CreateWindow("hi", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                          1000, 500, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN |
                                     SDL_WINDOW_RESIZABLE);
     if (!window)
         die("failed to create SDL window");
 
-    SDL_GLContext glcontext = SDL_GL_CreateContext(window);
+    glcontext = SDL_GL_CreateContext(window);
     if (!glcontext)
         die("failed to create SDL GL context");
 
-    mpv_render_param params[] = {
-        {MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_OPENGL},
-        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &(mpv_opengl_init_params){
-            .get_proc_address = get_proc_address_mpv,
-        }},
-        // Tell libmpv that you will call mpv_render_context_update() on render
-        // context update callbacks, and that you will _not_ block on the core
-        // ever (see <libmpv/render.h> "Threading" section for what libmpv
-        // functions you can call at all when this is active).
-        // In particular, this means you must call e.g. mpv_command_async()
-        // instead of mpv_command().
-        // If you want to use synchronous calls, either make them on a separate
-        // thread, or remove the option below (this will disable features like
-        // DR and is not recommended anyway).
-        {MPV_RENDER_PARAM_ADVANCED_CONTROL, &(int){1}},
-        {0}
-    };
+    SDL_DisplayMode mode;
+    double display_fps = 0;
+    if (SDL_GetWindowDisplayMode(window, &mode) == 0)
+        display_fps = mode.refresh_rate;
 
-    // This makes mpv use the currently set GL context. It will use the callback
-    // (passed via params) to resolve GL builtin functions, as well as extensions.
-    mpv_render_context *mpv_gl;
-    if (mpv_render_context_create(&mpv_gl, mpv, params) < 0)
-        die("failed to initialize mpv GL context");
+    if (display_sync) {
+        // Swaps must block until vsync, or there's nothing to sync to.
+        if (SDL_GL_SetSwapInterval(1) < 0)
+            printf("could not enable vsync\n");
+        // mpv can't query the refresh rate of a window it doesn't own. (The
+        // option was called override-display-fps before mpv 0.37.)
+        if (display_fps > 0) {
+            mpv_set_property_async(mpv, 0, "display-fps-override",
+                                   MPV_FORMAT_DOUBLE, &display_fps);
+            mpv_set_property_async(mpv, 0, "override-display-fps",
+                                   MPV_FORMAT_DOUBLE, &display_fps);
+        }
+    }
+
+    vsync_stats_init(&rt.vsync, display_fps, display_sync);
+    mpv_observe_property(mpv, 0, "container-fps", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(mpv, 0, "pause", MPV_FORMAT_FLAG);
+
+    rt.lock = SDL_CreateMutex();
+    rt.wakeup = SDL_CreateCond();
+    if (!rt.lock || !rt.wakeup)
+        die("could not create render thread locks");
+    SDL_GetWindowSize(window, &rt.w, &rt.h);
+
+    SDL_Thread *thread = NULL;
+    if (use_render_thread) {
+        // The context can be current on only one thread at a time.
+        SDL_GL_MakeCurrent(window, NULL);
+        thread = SDL_CreateThread(render_thread, "render", NULL);
+        if (!thread)
+            die("could not create render thread");
+        // Video output needs the render context, so wait for it before
+        // loading the file.
+        SDL_LockMutex(rt.lock);
+        while (!rt.ready)
+            SDL_CondWait(rt.wakeup, rt.lock);
+        SDL_UnlockMutex(rt.lock);
+    } else {
+        create_render_context();
+    }
+
+    SDL_LockMutex(rt.lock);
+    rs_init(&rt.stats, window, rt.gl_renderer);
+    SDL_UnlockMutex(rt.lock);
 
     // We use events for thread-safe notification of the SDL main loop.
     // Generally, the wakeup callbacks (set further below) should do as least
@@ -103,17 +325,26 @@ int main(int argc, char *argv[])
         wakeup_on_mpv_events == (Uint32)-1)
         die("could not register events");
 
+    // mpv calls the callbacks for every single event, but one SDL event is
+    // enough to make the main loop handle all of them.
+    wakeup_coalescer_init(&render_update_wakeup, push_event,
+                          &wakeup_on_mpv_render_update);
+    wakeup_coalescer_init(&events_wakeup, push_event, &wakeup_on_mpv_events);
+
     // When normal mpv events are available.
-    mpv_set_wakeup_callback(mpv, on_mpv_events, NULL);
+    mpv_set_wakeup_callback(mpv, wakeup_coalescer_notify, &events_wakeup);
 
     // When there is a need to call mpv_render_context_update(), which can
     // request a new frame to be rendered.
     // (Separate from the normal event handling mechanism for the sake of
-    //  users which run OpenGL on a different thread.)
-    mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, NULL);
+    //  users which run OpenGL on a different thread, like --render-thread.)
+    if (!use_render_thread) {
+        mpv_render_context_set_update_callback(mpv_gl, wakeup_coalescer_notify,
+                                               &render_update_wakeup);
+    }
 
     // Play this file.
-    const char *cmd[] = {"loadfile", argv[1], NULL};
+    const char *cmd[] = {"loadfile", file, NULL};
     mpv_command_async(mpv, 0, cmd);
 
     while (1) {
@@ -143,17 +374,25 @@ int main(int argc, char *argv[])
                 printf("attempting to save screenshot to %s\n", cmd_scr[1]);
                 mpv_command_async(mpv, 0, cmd_scr);
             }
+            if (event.key.keysym.sym == SDLK_h) {
+                SDL_LockMutex(rt.lock);
+                rt.stats.hud = !rt.stats.hud;
+                rs_update_hud(&rt.stats, mpv, 1);
+                SDL_UnlockMutex(rt.lock);
+            }
             break;
         default:
             // Happens when there is new work for the render thread (such as
             // rendering a new video frame or redrawing it).
             if (event.type == wakeup_on_mpv_render_update) {
+                wakeup_coalescer_begin(&render_update_wakeup);
                 uint64_t flags = mpv_render_context_update(mpv_gl);
                 if (flags & MPV_RENDER_UPDATE_FRAME)
                     redraw = 1;
             }
             // Happens when at least 1 new event is in the mpv event queue.
             if (event.type == wakeup_on_mpv_events) {
+                wakeup_coalescer_begin(&events_wakeup);
                 // Handle all remaining mpv events.
                 while (1) {
                     mpv_event *mp_event = mpv_wait_event(mpv, 0);
@@ -170,6 +409,24 @@ int main(int argc, char *argv[])
                             printf("log: %s", msg->text);
                         continue;
                     }
+                    if (mp_event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+                        mpv_event_property *prop = mp_event->data;
+                        SDL_LockMutex(rt.lock);
+                        if (strcmp(prop->name, "container-fps") == 0) {
+                            vsync_stats_set_fps(&rt.vsync,
+                                prop->format == MPV_FORMAT_DOUBLE
+                                ? *(double *)prop->data : 0);
+                        }
+                        // Don't count the time spent paused as a long frame.
+                        if (strcmp(prop->name, "pause") == 0)
+                            vsync_stats_reset(&rt.vsync);
+                        SDL_UnlockMutex(rt.lock);
+                    }
+                    if (mp_event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+                        SDL_LockMutex(rt.lock);
+                        vsync_stats_reset(&rt.vsync);
+                        SDL_UnlockMutex(rt.lock);
+                    }
                     printf("event: %s\n", mpv_event_name(mp_event->event_id));
                 }
             }
@@ -177,34 +434,40 @@ int main(int argc, char *argv[])
         if (redraw) {
             int w, h;
             SDL_GetWindowSize(window, &w, &h);
-            mpv_render_param params[] = {
-                // Specify the default framebuffer (0) as target. This will
-                // render onto the entire screen. If you want to show the video
-                // in a smaller rectangle or apply fancy transformations, you'll
-                // need to render into a separate FBO and draw it manually.
-                {MPV_RENDER_PARAM_OPENGL_FBO, &(mpv_opengl_fbo){
-                    .fbo = 0,
-                    .w = w,
-                    .h = h,
-                }},
-                // Flip rendering (needed due to flipped GL coordinate system).
-                {MPV_RENDER_PARAM_FLIP_Y, &(int){1}},
-                {0}
-            };
-            // See render_gl.h on what OpenGL environment mpv expects, and
-            // other API details.
-            mpv_render_context_render(mpv_gl, params);
-            SDL_GL_SwapWindow(window);
+            if (use_render_thread) {
+                SDL_LockMutex(rt.lock);
+                rt.w = w;
+                rt.h = h;
+                rt.redraw = 1;
+                SDL_CondSignal(rt.wakeup);
+                SDL_UnlockMutex(rt.lock);
+            } else {
+                render(w, h);
+            }
         }
     }
 done:
 
-    // Destroy the GL renderer and all of the GL objects it allocated. If video
-    // is still running, the video track will be deselected.
-    mpv_render_context_free(mpv_gl);
+    if (use_render_thread) {
+        // The render thread frees the render context.
+        SDL_LockMutex(rt.lock);
+        rt.quit = 1;
+        SDL_CondSignal(rt.wakeup);
+        SDL_UnlockMutex(rt.lock);
+        SDL_WaitThread(thread, NULL);
+    } else {
+        // Destroy the GL renderer and all of the GL objects it allocated. If
+        // video is still running, the video track will be deselected.
+        mpv_render_context_free(mpv_gl);
+    }
 
     mpv_destroy(mpv);
 
+    if (rs_save(&rt.stats, "render-stats.json") == 0)
+        printf("render stats written to render-stats.json\n");
+    if (vsync_stats_save(&rt.vsync, "vsync-stats.json") == 0)
+        printf("vsync stats written to vsync-stats.json\n");
+
     printf("properly terminated\n");
     return 0;
 }
@@ -1,15 +1,125 @@
 // Build with: gcc -o main_sw main_sw.c `pkg-config --libs --cflags mpv sdl2` -std=c99
+//
+// Usage: main_sw [--native] [--format=FMT] file
+//
+// The frame is rendered by mpv in the pixel format of a texture format the SDL
+// renderer supports natively (preferring the format of the window surface),
+// so SDL uploads and draws it without converting every pixel first.
+// --format=FMT forces an MPV_RENDER_PARAM_SW_FORMAT instead, e.g. for
+// comparing the cost of a conversion by SDL.
+//
+// By default, each frame is rendered by libmpv at window size. With --native,
+// it's rendered at the video's display size instead, and SDL scales it to the
+// window (on the GPU with most SDL render drivers). Resizing the window then
+// doesn't require any rendering by libmpv at all.
+//
+// Rendering happens on a separate thread, so a slow software render doesn't
+// delay input handling, and input handling doesn't delay rendering. The render
+// thread renders into one of three buffers, and the main thread uploads the
+// newest finished buffer to the texture and presents it. If the main thread
+// falls behind, older finished frames are dropped instead of queued.
+//
+// Press h to toggle a HUD with render timing statistics (see render_stats.inc).
+// The statistics are written to render-stats.json on exit.
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <SDL.h>
 
 #include <mpv/client.h>
 #include <mpv/render.h>
 
-static Uint32 wakeup_on_mpv_render_update, wakeup_on_mpv_events;
+#include "../common/wakeup_coalescer.h"
+
+#include "render_stats.inc"
+
+static Uint32 wakeup_on_frame_ready, wakeup_on_mpv_events;
+
+// At most one wakeup_on_mpv_events event is queued at a time.
+static struct wakeup_coalescer events_wakeup;
+
+#define NUM_BUFFERS 3
+
+struct frame {
+    void *mem;
+    // mem, aligned to 64 bytes.
+    char *pixels;
+    size_t size;
+    int w, h;
+    size_t stride;
+    // What was rendered, and how long it took.
+    mpv_render_frame_info info;
+    int64_t render_time;
+};
+
+// State shared between the main thread and the render thread.
+static struct {
+    SDL_mutex *lock;
+    SDL_cond *wakeup;
+    struct frame frames[NUM_BUFFERS];
+    // Newest finished frame the main thread hasn't picked up yet, or -1.
+    int ready;
+    // Frame the main thread picked up last, or -1. The render thread doesn't
+    // touch it (nor the ready frame), so the main thread can read it unlocked.
+    int shown;
+    // Size to render the next frame at.
+    int target_w, target_h;
+    // mpv_render_context_update() needs to be called.
+    int update;
+    // Render even if mpv has no new frame (e.g. the size changed).
+    int redraw;
+    int quit;
+    // The render thread records the render times, and the main thread the
+    // rest, but the main thread reads all of it for the HUD.
+    struct render_stats stats;
+} rt = {.ready = -1, .shown = -1};
+
+// The streaming texture. It's only re-created if a frame doesn't fit, so its
+// size is a capacity, and frames use the top-left frame_w x frame_h part.
+static SDL_Texture *tex;
+static int tex_cap_w, tex_cap_h;
+static int frame_w, frame_h;
+
+// SDL texture formats, and the MPV_RENDER_PARAM_SW_FORMAT with the same memory
+// layout. SDL's packed formats depend on the byte order, mpv's don't. For the
+// formats with alpha, the padding byte written by mpv ends up in the alpha
+// channel, which doesn't matter since the texture isn't blended.
+static const struct {
+    Uint32 sdl;
+    const char *mpv;
+    int bytes;
+} formats[] = {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    {SDL_PIXELFORMAT_XRGB8888,  "0rgb",     4},
+    {SDL_PIXELFORMAT_XBGR8888,  "0bgr",     4},
+    {SDL_PIXELFORMAT_RGBX8888,  "rgb0",     4},
+    {SDL_PIXELFORMAT_BGRX8888,  "bgr0",     4},
+    {SDL_PIXELFORMAT_ARGB8888,  "0rgb",     4},
+    {SDL_PIXELFORMAT_ABGR8888,  "0bgr",     4},
+    {SDL_PIXELFORMAT_RGBA8888,  "rgb0",     4},
+    {SDL_PIXELFORMAT_BGRA8888,  "bgr0",     4},
+#else
+    {SDL_PIXELFORMAT_XRGB8888,  "bgr0",     4},
+    {SDL_PIXELFORMAT_XBGR8888,  "rgb0",     4},
+    {SDL_PIXELFORMAT_RGBX8888,  "0bgr",     4},
+    {SDL_PIXELFORMAT_BGRX8888,  "0rgb",     4},
+    {SDL_PIXELFORMAT_ARGB8888,  "bgr0",     4},
+    {SDL_PIXELFORMAT_ABGR8888,  "rgb0",     4},
+    {SDL_PIXELFORMAT_RGBA8888,  "0bgr",     4},
+    {SDL_PIXELFORMAT_BGRA8888,  "0rgb",     4},
+#endif
+    {SDL_PIXELFORMAT_RGB24,     "rgb24",    3},
+    {SDL_PIXELFORMAT_BGR24,     "bgr24",    3},
+};
+
+#define NUM_FORMATS ((int)(sizeof(formats) / sizeof(formats[0])))
+
+// Index into formats[] of the format in use.
+static int format = -1;
 
 static void die(const char *msg)
 {
@@ -25,14 +135,224 @@ static void on_mpv_events(void *ctx)
 
 static void on_mpv_render_update(void *ctx)
 {
-    SDL_Event event = {.type = wakeup_on_mpv_render_update};
-    SDL_PushEvent(&event);
+    SDL_LockMutex(rt.lock);
+    rt.update = 1;
+    SDL_CondSignal(rt.wakeup);
+    SDL_UnlockMutex(rt.lock);
+}
+
+// Render thread only. Render the current video frame into f.
+static void render_frame(mpv_render_context *mpv_rd, struct frame *f,
+                         int w, int h)
+{
+    size_t stride = ((size_t)w * formats[format].bytes + 63) & ~(size_t)63;
+    size_t size = stride * h;
+    if (size > f->size) {
+        free(f->mem);
+        f->mem = malloc(size + 63);
+        if (!f->mem)
+            die("out of memory");
+        f->pixels = (char *)(((uintptr_t)f->mem + 63) & ~(uintptr_t)63);
+        f->size = size;
+    }
+    mpv_render_param params[] = {
+        {MPV_RENDER_PARAM_SW_SIZE, (int[2]){w, h}},
+        {MPV_RENDER_PARAM_SW_FORMAT, (void *)formats[format].mpv},
+        {MPV_RENDER_PARAM_SW_STRIDE, &stride},
+        {MPV_RENDER_PARAM_SW_POINTER, f->pixels},
+        {0}
+    };
+    f->info = (mpv_render_frame_info){0};
+    mpv_render_context_get_info(mpv_rd, (mpv_render_param){
+        MPV_RENDER_PARAM_NEXT_FRAME_INFO, &f->info});
+    int64_t t0 = rs_now();
+    int r = mpv_render_context_render(mpv_rd, params);
+    f->render_time = rs_now() - t0;
+    if (r < 0) {
+        printf("mpv_render_context_render error: %s\n", mpv_error_string(r));
+        exit(1);
+    }
+    f->w = w;
+    f->h = h;
+    f->stride = stride;
+}
+
+static int render_thread(void *ctx)
+{
+    mpv_render_context *mpv_rd = ctx;
+
+    SDL_LockMutex(rt.lock);
+    while (1) {
+        while (!rt.quit && !rt.update && !rt.redraw)
+            SDL_CondWait(rt.wakeup, rt.lock);
+        if (rt.quit)
+            break;
+        int update = rt.update, redraw = rt.redraw;
+        int w = rt.target_w, h = rt.target_h;
+        rt.update = rt.redraw = 0;
+        // With 3 buffers, there's always one that is neither ready nor shown.
+        int idx = 0;
+        while (idx == rt.ready || idx == rt.shown)
+            idx++;
+        SDL_UnlockMutex(rt.lock);
+
+        if (update && (mpv_render_context_update(mpv_rd) &
+                       MPV_RENDER_UPDATE_FRAME))
+            redraw = 1;
+        if (redraw && w > 0 && h > 0)
+            render_frame(mpv_rd, &rt.frames[idx], w, h);
+
+        SDL_LockMutex(rt.lock);
+        if (redraw && w > 0 && h > 0) {
+            struct frame *f = &rt.frames[idx];
+            rs_add_render(&rt.stats, &f->info, f->render_time);
+            // If the previous frame wasn't picked up yet, it's dropped, and
+            // the main thread already has an event pending.
+            int pending = rt.ready >= 0;
+            if (pending)
+                rt.stats.dropped++;
+            rt.ready = idx;
+            if (!pending) {
+                SDL_Event event = {.type = wakeup_on_frame_ready};
+                SDL_PushEvent(&event);
+            }
+        }
+    }
+    SDL_UnlockMutex(rt.lock);
+    return 0;
+}
+
+// Main thread only. Ask the render thread to render a frame at w x h.
+static void request_redraw(int w, int h)
+{
+    SDL_LockMutex(rt.lock);
+    rt.target_w = w;
+    rt.target_h = h;
+    rt.redraw = 1;
+    SDL_CondSignal(rt.wakeup);
+    SDL_UnlockMutex(rt.lock);
+}
+
+// Make sure the texture can hold a w x h frame.
+static void ensure_texture(SDL_Renderer *renderer, int w, int h)
+{
+    if (tex && w <= tex_cap_w && h <= tex_cap_h)
+        return;
+    // Grow by at least 1.5x in the dimension that doesn't fit, so that
+    // dragging a window edge only re-creates the texture a few times.
+    int cap_w = w > tex_cap_w ? w : tex_cap_w;
+    int cap_h = h > tex_cap_h ? h : tex_cap_h;
+    if (w > tex_cap_w && cap_w < tex_cap_w * 3 / 2)
+        cap_w = tex_cap_w * 3 / 2;
+    if (h > tex_cap_h && cap_h < tex_cap_h * 3 / 2)
+        cap_h = tex_cap_h * 3 / 2;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0 &&
+        info.max_texture_width > 0 && info.max_texture_height > 0)
+    {
+        if (cap_w > info.max_texture_width)
+            cap_w = info.max_texture_width;
+        if (cap_h > info.max_texture_height)
+            cap_h = info.max_texture_height;
+    }
+    if (w > cap_w || h > cap_h)
+        die("frame size exceeds the maximum texture size");
+
+    SDL_DestroyTexture(tex);
+    tex = SDL_CreateTexture(renderer, formats[format].sdl,
+                            SDL_TEXTUREACCESS_STREAMING, cap_w, cap_h);
+    if (!tex)
+        die("could not allocate texture");
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
+    tex_cap_w = cap_w;
+    tex_cap_h = cap_h;
+}
+
+// Returns the index into formats[] for an SDL texture format, or -1.
+static int find_sdl_format(Uint32 sdl)
+{
+    for (int n = 0; n < NUM_FORMATS; n++) {
+        if (formats[n].sdl == sdl)
+            return n;
+    }
+    return -1;
+}
+
+// Whether the renderer supports formats[idx] without conversion.
+static int is_native_format(SDL_Renderer *renderer, int idx)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info))
+        return 0;
+    for (Uint32 n = 0; n < info.num_texture_formats; n++) {
+        if (info.texture_formats[n] == formats[idx].sdl)
+            return 1;
+    }
+    return 0;
+}
+
+// Pick the texture format: the window surface's format if the renderer
+// supports it (the software renderer can then blit without converting),
+// otherwise the first supported one in the renderer's order of preference.
+// If the renderer supports none of them, SDL will convert on upload.
+static int choose_format(SDL_Window *window, SDL_Renderer *renderer)
+{
+    int idx = find_sdl_format(SDL_GetWindowPixelFormat(window));
+    if (idx >= 0 && is_native_format(renderer, idx))
+        return idx;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info))
+        return 0;
+    for (Uint32 n = 0; n < info.num_texture_formats; n++) {
+        idx = find_sdl_format(info.texture_formats[n]);
+        if (idx >= 0)
+            return idx;
+    }
+    return 0;
+}
+
+// Draw the current frame (the top-left part of the texture) to the window,
+// scaled to fit while keeping its aspect ratio.
+static void present(SDL_Window *window, SDL_Renderer *renderer)
+{
+    int win_w, win_h;
+    SDL_GetWindowSize(window, &win_w, &win_h);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    if (tex && frame_w > 0 && frame_h > 0) {
+        SDL_Rect src = {0, 0, frame_w, frame_h};
+        SDL_Rect dst = {0, 0, win_w, win_h};
+        if ((int64_t)win_w * frame_h > (int64_t)win_h * frame_w) {
+            dst.w = (int)((int64_t)win_h * frame_w / frame_h);
+            dst.x = (win_w - dst.w) / 2;
+        } else {
+            dst.h = (int)((int64_t)win_w * frame_h / frame_w);
+            dst.y = (win_h - dst.h) / 2;
+        }
+        SDL_RenderCopy(renderer, tex, &src, &dst);
+    }
+    SDL_RenderPresent(renderer);
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
-        die("pass a single media file as argument");
+    const char *file = NULL;
+    const char *force_format = NULL;
+    int native = 0;
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "--native") == 0) {
+            native = 1;
+        } else if (strncmp(argv[n], "--format=", 9) == 0) {
+            force_format = argv[n] + 9;
+        } else if (!file) {
+            file = argv[n];
+        } else {
+            file = NULL;
+            break;
+        }
+    }
+    if (!file)
+        die("usage: main_sw [--native] [--format=FMT] file");
 
     mpv_handle *mpv = mpv_create();
     if (!mpv)
@@ -49,6 +369,9 @@ int main(int argc, char *argv[])
     // Jesus Christ SDL, you suck!
     SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
 
+    // Scale the texture with bilinear filtering (only matters for --native).
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
         die("SDL init failed");
 
@@ -59,6 +382,23 @@ int main(int argc, char *argv[])
                                     &window, &renderer))
         die("failed to create SDL window");
 
+    if (force_format) {
+        // Prefer a format the renderer supports natively, if there are several
+        // with this layout.
+        for (int n = 0; n < NUM_FORMATS; n++) {
+            if (strcmp(formats[n].mpv, force_format) == 0 &&
+                (format < 0 || is_native_format(renderer, n)))
+                format = n;
+        }
+        if (format < 0)
+            die("unknown format");
+    } else {
+        format = choose_format(window, renderer);
+    }
+    printf("texture format: %s, mpv format: %s%s\n",
+           SDL_GetPixelFormatName(formats[format].sdl), formats[format].mpv,
+           is_native_format(renderer, format) ? "" : " (converted by SDL)");
+
     mpv_render_param params[] = {
         {MPV_RENDER_PARAM_API_TYPE, MPV_RENDER_API_TYPE_SW},
         // Tell libmpv that you will call mpv_render_context_update() on render
@@ -83,26 +423,58 @@ int main(int argc, char *argv[])
     // work as possible, and merely wake up another thread to do actual work.
     // On SDL, waking up the mainloop is the ideal course of action. SDL's
     // SDL_PushEvent() is thread-safe, so we use that.
-    wakeup_on_mpv_render_update = SDL_RegisterEvents(1);
+    wakeup_on_frame_ready = SDL_RegisterEvents(1);
     wakeup_on_mpv_events = SDL_RegisterEvents(1);
-    if (wakeup_on_mpv_render_update == (Uint32)-1 ||
+    if (wakeup_on_frame_ready == (Uint32)-1 ||
         wakeup_on_mpv_events == (Uint32)-1)
         die("could not register events");
 
-    // When normal mpv events are available.
-    mpv_set_wakeup_callback(mpv, on_mpv_events, NULL);
+    rt.lock = SDL_CreateMutex();
+    rt.wakeup = SDL_CreateCond();
+    if (!rt.lock || !rt.wakeup)
+        die("could not create render thread locks");
+
+    // When normal mpv events are available. mpv calls this for every single
+    // event, but one SDL event is enough to make the main loop handle all of
+    // them.
+    wakeup_coalescer_init(&events_wakeup, on_mpv_events, NULL);
+    mpv_set_wakeup_callback(mpv, wakeup_coalescer_notify, &events_wakeup);
 
     // When there is a need to call mpv_render_context_update(), which can
     // request a new frame to be rendered.
     // (Separate from the normal event handling mechanism for the sake of
-    //  users which run OpenGL on a different thread.)
+    //  users which render on a different thread, like we do.)
     mpv_render_context_set_update_callback(mpv_rd, on_mpv_render_update, NULL);
 
-    SDL_Texture *tex = NULL;
-    int tex_w = -1, tex_h = -1;
+    SDL_RendererInfo renderer_info;
+    if (SDL_GetRendererInfo(renderer, &renderer_info))
+        renderer_info.name = "unknown";
+    char renderer_name[128];
+    snprintf(renderer_name, sizeof(renderer_name), "%s, %s", renderer_info.name,
+             formats[format].mpv);
+    rs_init(&rt.stats, window, renderer_name);
+
+    int win_w, win_h;
+    SDL_GetWindowSize(window, &win_w, &win_h);
+    rt.target_w = win_w;
+    rt.target_h = win_h;
+
+    // From now on, only the render thread calls mpv_render_context_update()
+    // and mpv_render_context_render().
+    SDL_Thread *thread = SDL_CreateThread(render_thread, "render", mpv_rd);
+    if (!thread)
+        die("could not create render thread");
+
+    // The video size with aspect ratio applied, for --native. 0 while no
+    // video is loaded.
+    int64_t video_w = 0, video_h = 0;
+    if (native) {
+        mpv_observe_property(mpv, 0, "dwidth", MPV_FORMAT_INT64);
+        mpv_observe_property(mpv, 0, "dheight", MPV_FORMAT_INT64);
+    }
 
     // Play this file.
-    const char *cmd[] = {"loadfile", argv[1], NULL};
+    const char *cmd[] = {"loadfile", file, NULL};
     mpv_command_async(mpv, 0, cmd);
 
     while (1) {
@@ -110,12 +482,23 @@ int main(int argc, char *argv[])
         if (SDL_WaitEvent(&event) != 1)
             die("event loop error");
         int redraw = 0;
+        // Present the texture (without asking for a new frame).
+        int repaint = 0;
+        // Time spent on the frame before presenting it, or -1 if there's no
+        // new frame.
+        int64_t frame_time = -1;
         switch (event.type) {
         case SDL_QUIT:
             goto done;
         case SDL_WINDOWEVENT:
-            if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
-                redraw = 1;
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                // With --native, the frame doesn't depend on the window size.
+                if (native && frame_w > 0) {
+                    repaint = 1;
+                } else {
+                    redraw = 1;
+                }
+            }
             break;
         case SDL_KEYDOWN:
             if (event.key.keysym.sym == SDLK_SPACE) {
@@ -132,73 +515,107 @@ int main(int argc, char *argv[])
                 printf("attempting to save screenshot to %s\n", cmd_scr[1]);
                 mpv_command_async(mpv, 0, cmd_scr);
             }
+            if (event.key.keysym.sym == SDLK_h) {
+                SDL_LockMutex(rt.lock);
+                rt.stats.hud = !rt.stats.hud;
+                rs_update_hud(&rt.stats, mpv, 1);
+                SDL_UnlockMutex(rt.lock);
+            }
             break;
         default:
-            // Happens when there is new work for the render thread (such as
-            // rendering a new video frame or redrawing it).
-            if (event.type == wakeup_on_mpv_render_update) {
-                uint64_t flags = mpv_render_context_update(mpv_rd);
-                if (flags & MPV_RENDER_UPDATE_FRAME)
-                    redraw = 1;
+            // Happens when the render thread finished a frame.
+            if (event.type == wakeup_on_frame_ready) {
+                SDL_LockMutex(rt.lock);
+                int idx = rt.ready;
+                if (idx >= 0) {
+                    rt.shown = idx;
+                    rt.ready = -1;
+                }
+                SDL_UnlockMutex(rt.lock);
+                if (idx >= 0) {
+                    struct frame *f = &rt.frames[idx];
+                    int64_t t0 = rs_now();
+                    ensure_texture(renderer, f->w, f->h);
+                    SDL_Rect rc = {0, 0, f->w, f->h};
+                    if (SDL_UpdateTexture(tex, &rc, f->pixels, f->stride))
+                        die("could not update texture");
+                    int64_t upload_time = rs_now() - t0;
+                    SDL_LockMutex(rt.lock);
+                    rs_add(&rt.stats, RS_UPLOAD, upload_time);
+                    SDL_UnlockMutex(rt.lock);
+                    frame_time = f->render_time + upload_time;
+                    frame_w = f->w;
+                    frame_h = f->h;
+                    repaint = 1;
+                }
             }
             // Happens when at least 1 new event is in the mpv event queue.
             if (event.type == wakeup_on_mpv_events) {
+                wakeup_coalescer_begin(&events_wakeup);
                 // Handle all remaining mpv events.
                 while (1) {
                     mpv_event *mp_event = mpv_wait_event(mpv, 0);
                     if (mp_event->event_id == MPV_EVENT_NONE)
                         break;
+                    if (mp_event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+                        mpv_event_property *prop = mp_event->data;
+                        int64_t v = prop->format == MPV_FORMAT_INT64
+                                    ? *(int64_t *)prop->data : 0;
+                        if (strcmp(prop->name, "dwidth") == 0)
+                            video_w = v;
+                        if (strcmp(prop->name, "dheight") == 0)
+                            video_h = v;
+                        redraw = 1;
+                    }
                 }
             }
         }
         if (redraw) {
             int w, h;
-            SDL_GetWindowSize(window, &w, &h);
-            if (!tex || tex_w != w || tex_h != h) {
-                SDL_DestroyTexture(tex);
-                tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBX8888,
-                                        SDL_TEXTUREACCESS_STREAMING, w, h);
-                if (!tex) {
-                    printf("could not allocate texture\n");
-                    exit(1);
-                }
-                tex_w = w;
-                tex_h = h;
-            }
-            void *pixels;
-            int pitch;
-            if (SDL_LockTexture(tex, NULL, &pixels, &pitch)) {
-                printf("could not lock texture\n");
-                exit(1);
+            if (native && video_w > 0 && video_h > 0) {
+                w = video_w;
+                h = video_h;
+            } else {
+                SDL_GetWindowSize(window, &w, &h);
             }
-            mpv_render_param params[] = {
-                {MPV_RENDER_PARAM_SW_SIZE, (int[2]){w, h}},
-                {MPV_RENDER_PARAM_SW_FORMAT, "0bgr"},
-                {MPV_RENDER_PARAM_SW_STRIDE, &(size_t){pitch}},
-                {MPV_RENDER_PARAM_SW_POINTER, pixels},
-                {0}
-            };
-            int r = mpv_render_context_render(mpv_rd, params);
-            if (r < 0) {
-                printf("mpv_render_context_render error: %s\n",
-                       mpv_error_string(r));
-                exit(1);
-            }
-            SDL_UnlockTexture(tex);
-            SDL_RenderCopy(renderer, tex, NULL, NULL);
-            SDL_RenderPresent(renderer);
+            request_redraw(w, h);
+        }
+        if (repaint) {
+            int64_t t0 = rs_now();
+            present(window, renderer);
+            int64_t present_time = rs_now() - t0;
+            SDL_LockMutex(rt.lock);
+            rs_add(&rt.stats, RS_PRESENT, present_time);
+            if (frame_time >= 0)
+                rs_add(&rt.stats, RS_FRAME, frame_time + present_time);
+            rs_update_hud(&rt.stats, mpv, 0);
+            SDL_UnlockMutex(rt.lock);
         }
     }
 done:
 
+    SDL_LockMutex(rt.lock);
+    rt.quit = 1;
+    SDL_CondSignal(rt.wakeup);
+    SDL_UnlockMutex(rt.lock);
+    SDL_WaitThread(thread, NULL);
+
     SDL_DestroyTexture(tex);
 
     // Destroy the GL renderer and all of the GL objects it allocated. If video
     // is still running, the video track will be deselected.
     mpv_render_context_free(mpv_rd);
 
+    for (int n = 0; n < NUM_BUFFERS; n++)
+        free(rt.frames[n].mem);
+    SDL_DestroyCond(rt.wakeup);
+    SDL_DestroyMutex(rt.lock);
+
     mpv_destroy(mpv);
 
+    if (rs_save(&rt.stats, "render-stats.json") == 0)
+        printf("render stats written to render-stats.json\n");
+
     printf("properly terminated\n");
     return 0;
 }
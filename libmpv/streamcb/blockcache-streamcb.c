@@ -0,0 +1,145 @@
+// Build with: gcc -o blockcache-streamcb blockcache-streamcb.c `pkg-config --libs --cflags mpv` -pthread
+
+#define _FILE_OFFSET_BITS 64
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For file_stream_open_path() and blockcache_*(). Also pulls in headers.
+#include "streamcb_file.inc"
+#include "streamcb_blockcache.inc"
+
+#define MAX_INSTANCES 16
+
+// Shared by all streams of all mpv instances in this process.
+static struct blockcache *cache;
+
+// The mpv wakeup callbacks just signal this, and the main thread polls all
+// mpv instances.
+static pthread_mutex_t wakeup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup_cond = PTHREAD_COND_INITIALIZER;
+static int wakeup_pending;
+
+static void wakeup(void *ctx)
+{
+    pthread_mutex_lock(&wakeup_lock);
+    wakeup_pending = 1;
+    pthread_cond_signal(&wakeup_cond);
+    pthread_mutex_unlock(&wakeup_lock);
+}
+
+static int open_fn(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    const char *path = user_data;
+    char key[128];
+    if (!blockcache_file_key(path, key, sizeof(key)))
+        return MPV_ERROR_LOADING_FAILED;
+    int r = file_stream_open_path(path, info);
+    if (r < 0)
+        return r;
+    if (blockcache_stream_wrap(info, cache, key) < 0) {
+        info->close_fn(info->cookie);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+    return 0;
+}
+
+static void print_stats(void)
+{
+    struct blockcache_stats st = blockcache_get_stats(cache);
+    printf("cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " waits, "
+           "%" PRIu64 " evictions, %" PRIu64 " KiB used\n", st.hits, st.misses,
+           st.waits, st.evictions, st.bytes / 1024);
+}
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3) {
+        printf("usage: %s file [number of players]\n", argv[0]);
+        return 1;
+    }
+    int num = argc > 2 ? atoi(argv[2]) : 4;
+    if (num < 1 || num > MAX_INSTANCES) {
+        printf("between 1 and %d players are supported\n", MAX_INSTANCES);
+        return 1;
+    }
+
+    // 256 MiB in 64 KiB blocks.
+    cache = blockcache_create(256 << 20, 64 << 10);
+    if (!cache) {
+        printf("failed creating cache\n");
+        return 1;
+    }
+
+    // Several independent players showing the same file, e.g. a monitoring
+    // wall. Only the first one to read a block actually reads the file.
+    mpv_handle *players[MAX_INSTANCES];
+    for (int n = 0; n < num; n++) {
+        mpv_handle *ctx = mpv_create();
+        if (!ctx) {
+            printf("failed creating context\n");
+            return 1;
+        }
+        check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+        mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+        int val = 1;
+        check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+        check_error(mpv_initialize(ctx));
+        check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", argv[1], open_fn));
+        mpv_set_wakeup_callback(ctx, wakeup, NULL);
+        players[n] = ctx;
+    }
+
+    for (int n = 0; n < num; n++) {
+        const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+        check_error(mpv_command(players[n], cmd));
+    }
+
+    // Let it play, and wait until the user quits all players.
+    int running = num;
+    while (running) {
+        pthread_mutex_lock(&wakeup_lock);
+        while (!wakeup_pending)
+            pthread_cond_wait(&wakeup_cond, &wakeup_lock);
+        wakeup_pending = 0;
+        pthread_mutex_unlock(&wakeup_lock);
+
+        for (int n = 0; n < num; n++) {
+            if (!players[n])
+                continue;
+            while (1) {
+                mpv_event *event = mpv_wait_event(players[n], 0);
+                if (event->event_id == MPV_EVENT_NONE)
+                    break;
+                printf("player %d event: %s\n", n,
+                       mpv_event_name(event->event_id));
+                if (event->event_id == MPV_EVENT_FILE_LOADED)
+                    print_stats();
+                if (event->event_id == MPV_EVENT_SHUTDOWN) {
+                    mpv_terminate_destroy(players[n]);
+                    players[n] = NULL;
+                    running--;
+                    break;
+                }
+            }
+        }
+    }
+
+    print_stats();
+    blockcache_destroy(cache);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Build with: gcc -o chunkstore-streamcb chunkstore-streamcb.c `pkg-config --libs --cflags mpv`
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For chunkstore_*(). Also pulls in headers.
+#include "streamcb_chunkstore.inc"
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        printf("usage: %s store-directory manifest\n", argv[0]);
+        return 1;
+    }
+
+    // The manifest is parsed once, and shared by all streams opened from it.
+    struct chunkstore_manifest *manifest =
+        chunkstore_manifest_load(argv[2], argv[1]);
+    if (!manifest) {
+        printf("could not load manifest\n");
+        return 1;
+    }
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    check_error(mpv_request_log_messages(ctx, "v"));
+
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", manifest,
+                                     chunkstore_stream_open));
+
+    // Play this file.
+    const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            struct mpv_event_log_message *msg = (struct mpv_event_log_message *)event->data;
+            printf("[%s] %s: %s", msg->prefix, msg->level, msg->text);
+            continue;
+        }
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+    chunkstore_manifest_free(manifest);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Build with: gcc -o follow-streamcb follow-streamcb.c `pkg-config --libs --cflags mpv`
+//
+// Plays a file while it is still being written (e.g. a recording in
+// progress). Usage:
+//
+//   follow-streamcb [--min-lag=BYTES] [--max-lag=BYTES] [--idle-timeout=MS]
+//                   file
+//
+// For example, record with "ffmpeg -re -i input.mkv -c copy rec.ts" in the
+// background, and run "follow-streamcb rec.ts" at the same time.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For follow_stream_open_path(). Also pulls in headers.
+#include "streamcb_follow.inc"
+
+static const char *path;
+static struct follow_opts opts;
+
+static int open_fn(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    return follow_stream_open_path(path, &opts, info);
+}
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    opts = follow_opts_default;
+    for (int n = 1; n < argc; n++) {
+        if (strncmp(argv[n], "--min-lag=", 10) == 0) {
+            opts.min_lag_bytes = atoll(argv[n] + 10);
+        } else if (strncmp(argv[n], "--max-lag=", 10) == 0) {
+            opts.max_lag_bytes = atoll(argv[n] + 10);
+        } else if (strncmp(argv[n], "--idle-timeout=", 15) == 0) {
+            opts.idle_timeout_ms = atoi(argv[n] + 15);
+        } else {
+            path = argv[n];
+        }
+    }
+    if (!path) {
+        printf("pass a single media file as argument\n");
+        return 1;
+    }
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    check_error(mpv_request_log_messages(ctx, "v"));
+
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", NULL, open_fn));
+
+    // Play this file.
+    const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            struct mpv_event_log_message *msg = (struct mpv_event_log_message *)event->data;
+            printf("[%s] %s: %s", msg->prefix, msg->level, msg->text);
+            continue;
+        }
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+    return 0;
+}
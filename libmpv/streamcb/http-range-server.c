@@ -0,0 +1,228 @@
+// Build with: gcc -o http-range-server http-range-server.c -pthread
+//
+// Minimal HTTP/1.1 file server with range request and keep-alive support, as
+// stand-in origin for testing http-streamcb on loopback. Not a real web
+// server: no security beyond refusing ".." in paths, one thread per
+// connection, GET/HEAD only.
+//
+// Usage:
+//
+//   http-range-server [--port=N] [--delay-ms=N] directory
+//
+// --delay-ms adds a fixed delay before every response, to simulate an origin
+// with high per-request latency. The server listens on 127.0.0.1 only.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *root;
+static int delay_ms;
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static bool send_all(int fd, const char *buf, size_t size)
+{
+    while (size) {
+        ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool send_status(int fd, int status, const char *text)
+{
+    char hdr[256];
+    int len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\n"
+                       "Content-Length: 0\r\n\r\n", status, text);
+    return send_all(fd, hdr, len);
+}
+
+// Handle one request. Returns false if the connection should be closed.
+static bool handle_request(int fd, char *req)
+{
+    char method[16], path[2048];
+    if (sscanf(req, "%15s %2047s HTTP/1.%*d", method, path) != 2)
+        return false;
+    bool head = strcmp(method, "HEAD") == 0;
+    if (!head && strcmp(method, "GET") != 0)
+        return send_status(fd, 405, "Method Not Allowed");
+    if (path[0] != '/' || strstr(path, ".."))
+        return send_status(fd, 404, "Not Found");
+
+    if (delay_ms) {
+        struct timespec ts = {delay_ms / 1000, (delay_ms % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+
+    char file[4096];
+    snprintf(file, sizeof(file), "%s%s", root, path);
+    int file_fd = open(file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (file_fd < 0 || fstat(file_fd, &st) || !S_ISREG(st.st_mode)) {
+        if (file_fd >= 0)
+            close(file_fd);
+        return send_status(fd, 404, "Not Found");
+    }
+
+    long long size = st.st_size, start = 0, end = size - 1;
+    bool partial = false, keep_alive = true;
+    for (char *line = strstr(req, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, "Connection: close", 17) == 0)
+            keep_alive = false;
+        if (strncasecmp(line, "Range: bytes=", 13) == 0) {
+            long long a = -1, b = -1;
+            if (sscanf(line + 13, "%lld-%lld", &a, &b) < 1 || a < 0 ||
+                a >= size || (b >= 0 && b < a))
+            {
+                close(file_fd);
+                char hdr[256];
+                int len = snprintf(hdr, sizeof(hdr),
+                    "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                    "Content-Range: bytes */%lld\r\n"
+                    "Content-Length: 0\r\n\r\n", size);
+                return send_all(fd, hdr, len);
+            }
+            start = a;
+            if (b >= 0 && b < end)
+                end = b;
+            partial = true;
+        }
+    }
+
+    char hdr[512];
+    int len;
+    if (partial) {
+        len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\n"
+                       "Accept-Ranges: bytes\r\n"
+                       "Content-Range: bytes %lld-%lld/%lld\r\n"
+                       "Content-Length: %lld\r\n\r\n",
+                       start, end, size, end - start + 1);
+    } else {
+        len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+                       "Accept-Ranges: bytes\r\n"
+                       "Content-Length: %lld\r\n\r\n", size);
+    }
+    bool ok = send_all(fd, hdr, len);
+
+    static __thread char buf[256 << 10];
+    long long pos = start;
+    while (ok && !head && pos <= end) {
+        // pos <= end, so this is positive.
+        size_t want = (size_t)(end - pos + 1);
+        if (want > sizeof(buf))
+            want = sizeof(buf);
+        ssize_t n = pread(file_fd, buf, want, pos);
+        if (n <= 0)
+            ok = false;
+        if (ok)
+            ok = send_all(fd, buf, n);
+        pos += n;
+    }
+    close(file_fd);
+    return ok && keep_alive;
+}
+
+static void *connection_thread(void *p)
+{
+    int fd = (int)(intptr_t)p;
+    char req[16384] = "";
+    size_t len = 0;
+
+    while (1) {
+        // Requests have no body, so everything up to the empty line is one
+        // request.
+        char *end;
+        while (!(end = strstr(req, "\r\n\r\n"))) {
+            if (len == sizeof(req) - 1)
+                goto done;
+            ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                goto done;
+            len += n;
+            req[len] = '\0';
+        }
+        end += 4;
+        char saved = *end;
+        *end = '\0';
+        bool keep = handle_request(fd, req);
+        *end = saved;
+        len -= end - req;
+        memmove(req, end, len);
+        req[len] = '\0';
+        if (!keep)
+            break;
+    }
+done:
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int port = 8080;
+    for (int n = 1; n < argc; n++) {
+        if (strncmp(argv[n], "--port=", 7) == 0) {
+            port = atoi(argv[n] + 7);
+        } else if (strncmp(argv[n], "--delay-ms=", 11) == 0) {
+            delay_ms = atoi(argv[n] + 11);
+        } else {
+            root = argv[n];
+        }
+    }
+    if (!root)
+        die("usage: http-range-server [--port=N] [--delay-ms=N] directory");
+
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0)
+        die("socket failed");
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(lfd, 64))
+        die("could not listen");
+    printf("serving %s on http://127.0.0.1:%d/\n", root, port);
+    fflush(stdout);
+
+    while (1) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread,
+                           (void *)(intptr_t)fd))
+        {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,87 @@
+// Build with: gcc -o http-streamcb http-streamcb.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Test on loopback with:
+//
+//   http-range-server --delay-ms=100 /path/to/media &
+//   http-streamcb http://127.0.0.1:8080/file.mkv
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For http_stream_open_url(). Also pulls in headers.
+#include "streamcb_http.inc"
+
+static int open_fn(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    // myhttp://host/path -> http://host/path
+    char url[4096];
+    snprintf(url, sizeof(url), "http://%s", uri + strlen("myhttp://"));
+    return http_stream_open_url(url, NULL, info);
+}
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 || strncmp(argv[1], "http://", 7) != 0) {
+        printf("pass a single http:// URL as argument\n");
+        return 1;
+    }
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    check_error(mpv_request_log_messages(ctx, "v"));
+
+    // Use a custom protocol name, so that mpv's own http support isn't used.
+    check_error(mpv_stream_cb_add_ro(ctx, "myhttp", NULL, open_fn));
+
+    // Play this file.
+    char uri[4096];
+    snprintf(uri, sizeof(uri), "myhttp://%s", argv[1] + strlen("http://"));
+    const char *cmd[] = {"loadfile", uri, NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            struct mpv_event_log_message *msg = (struct mpv_event_log_message *)event->data;
+            printf("[%s] %s: %s", msg->prefix, msg->level, msg->text);
+            continue;
+        }
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Build with: gcc -o memory-streamcb memory-streamcb.c `pkg-config --libs --cflags mpv`
+//
+// Loads a file into memory as a list of separately allocated 1 MiB segments
+// (standing in for buffers an application already has), and plays it from
+// there without joining them.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For membuf_*(). Also pulls in headers.
+#include "streamcb_memory.inc"
+
+#define SEGMENT_SIZE (1 << 20)
+#define MAX_SEGMENTS 65536
+
+static void free_segment(void *opaque)
+{
+    free(opaque);
+}
+
+// Read the file into a list of malloc'ed segments.
+static struct membuf *load_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    static struct membuf_segment segments[MAX_SEGMENTS];
+    int num = 0;
+    while (num < MAX_SEGMENTS) {
+        char *data = malloc(SEGMENT_SIZE);
+        size_t size = data ? fread(data, 1, SEGMENT_SIZE, f) : 0;
+        if (!size) {
+            free(data);
+            break;
+        }
+        segments[num++] = (struct membuf_segment){
+            .data = data,
+            .size = size,
+            .free_fn = free_segment,
+            .opaque = data,
+        };
+    }
+    fclose(f);
+    struct membuf *m = membuf_create(segments, num);
+    if (!m) {
+        for (int n = 0; n < num; n++)
+            free(segments[n].opaque);
+    }
+    return m;
+}
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        printf("pass a single media file as argument\n");
+        return 1;
+    }
+
+    struct membuf *buf = load_file(argv[1]);
+    if (!buf) {
+        printf("could not load file\n");
+        return 1;
+    }
+    printf("loaded %d segments\n", buf->num_segments);
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    check_error(mpv_request_log_messages(ctx, "v"));
+
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", buf,
+                                     membuf_stream_open));
+
+    // Play this file.
+    const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            struct mpv_event_log_message *msg = (struct mpv_event_log_message *)event->data;
+            printf("[%s] %s: %s", msg->prefix, msg->level, msg->text);
+            continue;
+        }
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_FILE_LOADED && buf) {
+            // The stream holds its own reference now. Dropping ours means
+            // the segments are freed as soon as mpv closes the stream (so it
+            // must not be loaded again).
+            membuf_unref(buf);
+            buf = NULL;
+        }
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+    membuf_unref(buf); // in case the file was never loaded
+    return 0;
+}
@@ -0,0 +1,86 @@
+// Build with: gcc -o readahead-streamcb readahead-streamcb.c `pkg-config --libs --cflags mpv` -pthread
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For file_stream_open_path() and readahead_stream_wrap(). Also pulls in
+// headers.
+#include "streamcb_file.inc"
+#include "streamcb_readahead.inc"
+
+static int open_fn(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    int r = file_stream_open_path(user_data, info);
+    if (r < 0)
+        return r;
+    // Move all reads to a prefetch thread, which keeps up to 4 MiB buffered
+    // ahead of the demuxer.
+    if (readahead_stream_wrap(info, NULL) < 0) {
+        info->close_fn(info->cookie);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+    return 0;
+}
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        printf("pass a single media file as argument\n");
+        return 1;
+    }
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    check_error(mpv_request_log_messages(ctx, "v"));
+
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", argv[1], open_fn));
+
+    // Play this file.
+    const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        if (event->event_id == MPV_EVENT_LOG_MESSAGE) {
+            struct mpv_event_log_message *msg = (struct mpv_event_log_message *)event->data;
+            printf("[%s] %s: %s", msg->prefix, msg->level, msg->text);
+            continue;
+        }
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+    return 0;
+}
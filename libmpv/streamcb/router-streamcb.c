@@ -0,0 +1,84 @@
+// Build with: gcc -o router-streamcb router-streamcb.c `pkg-config --libs --cflags mpv` -pthread
+
+#define _FILE_OFFSET_BITS 64
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// For router_open() and fdpool_*(). Also pulls in headers.
+#include "streamcb_router.inc"
+
+static inline void check_error(int status)
+{
+    if (status < 0) {
+        printf("mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        printf("usage: %s directory asset-id...\n", argv[0]);
+        return 1;
+    }
+
+    // Assets are files in the given directory. Keep at most 32 of them open.
+    struct router router = {
+        .pool = fdpool_create(32),
+        .catalog = router_dir_catalog(argv[1]),
+    };
+    if (!router.pool) {
+        printf("failed creating fd pool\n");
+        return 1;
+    }
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx) {
+        printf("failed creating context\n");
+        return 1;
+    }
+
+    // Enable default key bindings, so the user can actually interact with
+    // the player (and e.g. close the window).
+    check_error(mpv_set_option_string(ctx, "input-default-bindings", "yes"));
+
+    mpv_set_option_string(ctx, "input-vo-keyboard", "yes");
+    int val = 1;
+    check_error(mpv_set_option(ctx, "osc", MPV_FORMAT_FLAG, &val));
+
+    // Done setting up options.
+    check_error(mpv_initialize(ctx));
+
+    // One handler for all assets; the asset is selected by the URI.
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", &router, router_open));
+
+    // Queue all assets as a playlist.
+    for (int n = 2; n < argc; n++) {
+        char uri[512];
+        snprintf(uri, sizeof(uri), "myprotocol://%s", argv[n]);
+        const char *cmd[] = {"loadfile", uri, "append-play", NULL};
+        check_error(mpv_command(ctx, cmd));
+    }
+
+    // Let it play, and wait until the user quits.
+    while (1) {
+        mpv_event *event = mpv_wait_event(ctx, 10000);
+        printf("event: %s\n", mpv_event_name(event->event_id));
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+    }
+
+    mpv_terminate_destroy(ctx);
+
+    struct fdpool_stats st = fdpool_get_stats(router.pool);
+    printf("fd pool: %" PRIu64 " opens, %" PRIu64 " reuses, %" PRIu64
+           " evictions\n", st.opens, st.reuses, st.evictions);
+    fdpool_destroy(router.pool);
+    return 0;
+}
@@ -1,5 +1,8 @@
 // Build with: gcc -o simple-streamcb simple-streamcb.c `pkg-config --libs --cflags mpv`
 
+// Make off_t 64 bit, so that fseeko() works with files larger than 2 GiB.
+#define _FILE_OFFSET_BITS 64
+
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,9 +34,8 @@ static int64_t read_fn(void *cookie, char *buf, uint64_t nbytes)
 static int64_t seek_fn(void *cookie, int64_t offset)
 {
     FILE *fp = cookie;
-    // not 64-bit safe
-    int r = fseek(fp, offset, SEEK_SET);
-    return r < 0 ? MPV_ERROR_GENERIC : r;
+    int r = fseeko(fp, offset, SEEK_SET);
+    return r < 0 ? MPV_ERROR_GENERIC : offset;
 }
 
 static void close_fn(void *cookie)
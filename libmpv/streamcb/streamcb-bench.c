@@ -0,0 +1,375 @@
+// Build with: gcc -o streamcb-bench streamcb-bench.c `pkg-config --libs --cflags mpv` -pthread
+//
+// Headless I/O benchmark for stream_cb backends. Plays a file with vo=null and
+// ao=null through a profiling wrapper, and prints a JSON object with startup
+// and seek times and I/O statistics to stdout. At the end, it measures how
+// long the "stop" command takes, which depends on how quickly blocked reads
+// can be cancelled.
+//
+// Usage:
+//
+//   streamcb-bench [options] file
+//
+//   --backend=file|mmap   backend to use (default: file)
+//   --readahead           wrap the backend with the read-ahead thread
+//   --latency-ms=MS       simulated storage latency per read (default 0)
+//   --seek-latency-ms=MS  simulated storage latency per seek (default 0)
+//   --jitter-ms=MS        random extra latency up to MS per read or seek
+//   --bandwidth=BYTES     simulated storage throughput in bytes per second,
+//                         K/M/G suffixes allowed (default: unlimited)
+//   --seed=N              seed for the jitter (default 1)
+//   --prefetch-dir=DIR    record the ranges read during startup to a trace in
+//                         DIR, and prefetch them in parallel on the next run
+//   --seek=SECONDS        after startup, seek to this absolute time and wait
+//                         for playback to restart (can be repeated)
+//   --set=NAME=VALUE      set an mpv option before initialization (can be
+//                         repeated), e.g. --set=demuxer-max-bytes=1MiB
+//   --timeout=SECONDS     give up if nothing happens for this long (default
+//                         30)
+//
+// The simulated storage sits directly on top of the backend, i.e. below the
+// read-ahead wrapper, so --readahead shows how much of the latency it hides.
+// The prefetch threads read through the simulated storage as well.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+// Backends and wrappers. Also pulls in headers.
+#include "streamcb_file.inc"
+#include "streamcb_mmap.inc"
+#include "streamcb_readahead.inc"
+#include "streamcb_throttle.inc"
+#include "streamcb_prefetch.inc"
+#include "streamcb_profile.inc"
+
+#define MAX_SEEKS 64
+#define MAX_OPTIONS 64
+
+struct bench_opts {
+    const char *path;
+    const char *backend;
+    bool readahead;
+    struct throttle_opts throttle;
+    const char *prefetch_dir;
+    double seeks[MAX_SEEKS];
+    int num_seeks;
+    const char *options[MAX_OPTIONS];
+    int num_options;
+    double timeout;
+};
+
+static struct bench_opts opts = {
+    .backend = "file",
+    .throttle = {.seed = 1},
+    .timeout = 30,
+};
+
+static struct profile_stats io_stats;
+static struct prefetch_stats prefetch_stats;
+
+static bool throttle_enabled(void)
+{
+    struct throttle_opts *t = &opts.throttle;
+    return t->read_latency_us || t->seek_latency_us || t->jitter_us ||
+           t->bytes_per_second;
+}
+
+// Open the backend, including the simulated storage. Also used by the
+// prefetch threads.
+static int open_backend(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    int r;
+    if (strcmp(opts.backend, "mmap") == 0) {
+        r = mmap_stream_open_path(opts.path, info);
+    } else {
+        r = file_stream_open_path(opts.path, info);
+    }
+    if (r < 0)
+        return r;
+    if (throttle_enabled() &&
+        throttle_stream_wrap(info, &opts.throttle, uri) < 0)
+    {
+        info->close_fn(info->cookie);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+    return 0;
+}
+
+static int open_fn(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    int r = open_backend(user_data, uri, info);
+    if (r < 0)
+        return r;
+    if (opts.prefetch_dir) {
+        // Identify the content by path, size and modification time, so that
+        // a changed file doesn't use an outdated trace.
+        struct stat st;
+        char key[4200];
+        if (stat(opts.path, &st))
+            goto fail;
+        snprintf(key, sizeof(key), "%s:%lld:%lld", opts.path,
+                 (long long)st.st_size, (long long)st.st_mtime);
+        struct prefetch_opts popts = {
+            .trace_dir = opts.prefetch_dir,
+            .open_fn = open_backend,
+            .stats = &prefetch_stats,
+        };
+        if (prefetch_stream_wrap(info, &popts, key, uri) < 0)
+            goto fail;
+    }
+    // The profiler is the outermost wrapper, so it records exactly what the
+    // demuxer requests.
+    if (opts.readahead && readahead_stream_wrap(info, NULL) < 0)
+        goto fail;
+    if (profile_stream_wrap(info, &io_stats) < 0)
+        goto fail;
+    return 0;
+fail:
+    info->close_fn(info->cookie);
+    return MPV_ERROR_LOADING_FAILED;
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void check_error(int status)
+{
+    if (status < 0) {
+        fprintf(stderr, "mpv API error: %s\n", mpv_error_string(status));
+        exit(1);
+    }
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Copy the NAME part of a NAME=VALUE option to name, and return VALUE.
+static const char *split_option(const char *opt, char *name, size_t name_size)
+{
+    const char *eq = strchr(opt, '=');
+    snprintf(name, name_size, "%.*s", (int)(eq - opt), opt);
+    return eq + 1;
+}
+
+// Parse a byte count with optional K/M/G (binary) suffix.
+static int64_t parse_bytes(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+    case 'K': case 'k': v *= 1 << 10; break;
+    case 'M': case 'm': v *= 1 << 20; break;
+    case 'G': case 'g': v *= 1 << 30; break;
+    }
+    return v;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--backend=", 10) == 0) {
+            opts.backend = arg + 10;
+            if (strcmp(opts.backend, "file") && strcmp(opts.backend, "mmap"))
+                die("unknown backend");
+        } else if (strcmp(arg, "--readahead") == 0) {
+            opts.readahead = true;
+        } else if (strncmp(arg, "--latency-ms=", 13) == 0) {
+            opts.throttle.read_latency_us = atof(arg + 13) * 1000;
+        } else if (strncmp(arg, "--seek-latency-ms=", 18) == 0) {
+            opts.throttle.seek_latency_us = atof(arg + 18) * 1000;
+        } else if (strncmp(arg, "--jitter-ms=", 12) == 0) {
+            opts.throttle.jitter_us = atof(arg + 12) * 1000;
+        } else if (strncmp(arg, "--bandwidth=", 12) == 0) {
+            opts.throttle.bytes_per_second = parse_bytes(arg + 12);
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            opts.throttle.seed = strtoull(arg + 7, NULL, 0);
+        } else if (strncmp(arg, "--prefetch-dir=", 15) == 0) {
+            opts.prefetch_dir = arg + 15;
+        } else if (strncmp(arg, "--seek=", 7) == 0) {
+            if (opts.num_seeks == MAX_SEEKS)
+                die("too many seeks");
+            opts.seeks[opts.num_seeks++] = atof(arg + 7);
+        } else if (strncmp(arg, "--set=", 6) == 0) {
+            if (opts.num_options == MAX_OPTIONS || !strchr(arg + 6, '='))
+                die("invalid --set");
+            opts.options[opts.num_options++] = arg + 6;
+        } else if (strncmp(arg, "--timeout=", 10) == 0) {
+            opts.timeout = atof(arg + 10);
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            die("unknown option");
+        } else if (!opts.path) {
+            opts.path = arg;
+        } else {
+            die("only one file can be passed");
+        }
+    }
+    if (!opts.path)
+        die("usage: streamcb-bench [options] file");
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+
+    mpv_handle *ctx = mpv_create();
+    if (!ctx)
+        die("failed creating context");
+
+    // No video or audio output; this measures demuxing and decoding only.
+    check_error(mpv_set_option_string(ctx, "vo", "null"));
+    check_error(mpv_set_option_string(ctx, "ao", "null"));
+
+    for (int n = 0; n < opts.num_options; n++) {
+        char name[256];
+        const char *value = split_option(opts.options[n], name, sizeof(name));
+        check_error(mpv_set_option_string(ctx, name, value));
+    }
+
+    check_error(mpv_initialize(ctx));
+    check_error(mpv_stream_cb_add_ro(ctx, "myprotocol", NULL, open_fn));
+
+    double loaded_time = -1, restart_time = -1;
+    double seek_times[MAX_SEEKS];
+    int seeks_done = 0;
+    const char *error = NULL;
+
+    uint64_t start = profile_now_ns();
+    uint64_t seek_start = 0;
+    const char *cmd[] = {"loadfile", "myprotocol://fake", NULL};
+    check_error(mpv_command(ctx, cmd));
+
+    while (!error) {
+        mpv_event *event = mpv_wait_event(ctx, opts.timeout);
+        double now = (profile_now_ns() - start) / 1e9;
+        if (event->event_id == MPV_EVENT_NONE) {
+            error = "timeout";
+        } else if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            error = "shutdown";
+        } else if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = event->data;
+            // EOF before all seeks were done is not fatal (seek targets past
+            // the end), but everything else is.
+            if (ef->reason == MPV_END_FILE_REASON_EOF && restart_time >= 0)
+                break;
+            error = ef->reason == MPV_END_FILE_REASON_ERROR
+                    ? mpv_error_string(ef->error) : "playback ended";
+        } else if (event->event_id == MPV_EVENT_FILE_LOADED) {
+            loaded_time = now;
+        } else if (event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+            if (restart_time < 0) {
+                restart_time = now;
+            } else {
+                seek_times[seeks_done++] =
+                    (profile_now_ns() - seek_start) / 1e9;
+            }
+            if (seeks_done == opts.num_seeks)
+                break;
+            char target[64];
+            snprintf(target, sizeof(target), "%f", opts.seeks[seeks_done]);
+            const char *cmd_seek[] = {"seek", target, "absolute", NULL};
+            seek_start = profile_now_ns();
+            check_error(mpv_command(ctx, cmd_seek));
+        }
+    }
+
+    // Time how long it takes to close the file (the same happens on
+    // "loadfile replace"). With slow storage, this is dominated by reads that
+    // are still in progress, unless the backend supports cancel_fn.
+    double stop_time = -1;
+    if (!error) {
+        uint64_t stop_start = profile_now_ns();
+        const char *cmd_stop[] = {"stop", NULL};
+        check_error(mpv_command(ctx, cmd_stop));
+        while (1) {
+            mpv_event *event = mpv_wait_event(ctx, opts.timeout);
+            if (event->event_id == MPV_EVENT_NONE ||
+                event->event_id == MPV_EVENT_SHUTDOWN)
+                break;
+            if (event->event_id == MPV_EVENT_END_FILE) {
+                stop_time = (profile_now_ns() - stop_start) / 1e9;
+                break;
+            }
+        }
+    }
+
+    mpv_terminate_destroy(ctx);
+
+    FILE *f = stdout;
+    fprintf(f, "{\"file\": ");
+    write_json_string(f, opts.path);
+    fprintf(f, ", \"backend\": ");
+    write_json_string(f, opts.backend);
+    fprintf(f, ", \"readahead\": %s, ", opts.readahead ? "true" : "false");
+    fprintf(f, "\"throttle\": {\"latency_ms\": %.3f, "
+            "\"seek_latency_ms\": %.3f, \"jitter_ms\": %.3f, "
+            "\"bytes_per_second\": %" PRId64 ", \"seed\": %" PRIu64 "}, "
+            "\"options\": {",
+            opts.throttle.read_latency_us / 1e3,
+            opts.throttle.seek_latency_us / 1e3,
+            opts.throttle.jitter_us / 1e3,
+            opts.throttle.bytes_per_second, opts.throttle.seed);
+    for (int n = 0; n < opts.num_options; n++) {
+        char name[256];
+        const char *value = split_option(opts.options[n], name, sizeof(name));
+        fprintf(f, "%s", n ? ", " : "");
+        write_json_string(f, name);
+        fprintf(f, ": ");
+        write_json_string(f, value);
+    }
+    fprintf(f, "}, \"error\": ");
+    if (error) {
+        write_json_string(f, error);
+    } else {
+        fprintf(f, "null");
+    }
+    fprintf(f, ", \"file_loaded_seconds\": %.6f, "
+            "\"playback_restart_seconds\": %.6f, \"seeks\": [",
+            loaded_time, restart_time);
+    for (int n = 0; n < seeks_done; n++) {
+        fprintf(f, "%s{\"target\": %f, \"seconds\": %.6f}", n ? ", " : "",
+                opts.seeks[n], seek_times[n]);
+    }
+    fprintf(f, "], \"stop_seconds\": %.6f, \"io\": ", stop_time);
+    profile_stats_write_json(f, &io_stats);
+    if (opts.prefetch_dir) {
+        struct prefetch_stats *ps = &prefetch_stats;
+        fprintf(f, ", \"prefetch\": {\"traces_used\": %" PRIu64
+                ", \"ranges\": %" PRIu64 ", \"hit_bytes\": %" PRIu64
+                ", \"miss_bytes\": %" PRIu64 ", \"waits\": %" PRIu64 "}",
+                (uint64_t)atomic_load(&ps->traces_used),
+                (uint64_t)atomic_load(&ps->ranges),
+                (uint64_t)atomic_load(&ps->hit_bytes),
+                (uint64_t)atomic_load(&ps->miss_bytes),
+                (uint64_t)atomic_load(&ps->waits));
+    }
+    fprintf(f, "}\n");
+
+    return error ? 1 : 0;
+}
@@ -74,13 +74,16 @@ void MpvFrame::MpvCreate(int64_t wid)
         throw std::runtime_error("failed to create mpv instance");
 
     Bind(WX_MPV_WAKEUP, &MpvFrame::OnMpvWakeupEvent, this);
-    mpv_set_wakeup_callback(mpv, [](void *data) {
+    // One event is enough to drain all mpv events that are queued by then, so
+    // don't allocate and queue another one for every single mpv event.
+    wakeup_coalescer_init(&wakeup, [](void *data) {
         auto window = reinterpret_cast<MpvFrame *>(data);
         if (window) {
             auto event = new wxThreadEvent(WX_MPV_WAKEUP);
             window->GetEventHandler()->QueueEvent(event);
         }
     }, this);
+    mpv_set_wakeup_callback(mpv, wakeup_coalescer_notify, &wakeup);
 
     if (mpv_set_property(mpv, "wid", MPV_FORMAT_INT64, &wid) < 0)
         throw std::runtime_error("failed to set mpv wid");
@@ -206,6 +209,7 @@ void MpvFrame::OnMpvEvent(mpv_event &event)
 
 void MpvFrame::OnMpvWakeupEvent(wxThreadEvent &)
 {
+    wakeup_coalescer_begin(&wakeup);
     while (mpv) {
         mpv_event *e = mpv_wait_event(mpv, 0);
         if (e->event_id == MPV_EVENT_NONE)
@@ -7,6 +7,8 @@
 
 #include <mpv/client.h>
 
+#include "../common/wakeup_coalescer.h"
+
 class MpvApp : public wxApp
 {
 public:
@@ -32,6 +34,8 @@ private:
     void OnMpvWakeupEvent(wxThreadEvent &event);
 
     mpv_handle *mpv = nullptr;
+    // Makes sure there's at most one WX_MPV_WAKEUP event queued.
+    wakeup_coalescer wakeup;
     
     wxDECLARE_EVENT_TABLE();
 };